@@ -0,0 +1,61 @@
+#include "allocations.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t allocations = 0;
+
+static void* Allocate(size_t size, size_t alignment)
+{
+  ++allocations;
+
+  void* p = alignment > alignof(std::max_align_t)
+      ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+      : std::malloc(size ? size : 1);
+
+  if (!p)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void* operator new(size_t size) { return Allocate(size, 0); }
+void* operator new[](size_t size) { return Allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t a) { return Allocate(size, size_t(a)); }
+void* operator new[](size_t size, std::align_val_t a) { return Allocate(size, size_t(a)); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+  try { return Allocate(size, 0); } catch (...) { return nullptr; }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+  try { return Allocate(size, 0); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+uint64_t AllocationCount()
+{
+  return allocations;
+}
+
+#else
+
+uint64_t AllocationCount()
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// Calls to the global allocator made by the calling thread since it started.
+// Only counted when built with COUNT_ALLOCATIONS, which replaces operator new,
+// otherwise always 0.
+uint64_t AllocationCount();
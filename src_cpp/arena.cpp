@@ -0,0 +1,68 @@
+#include "arena.h"
+
+#include <stdint.h>
+
+Arena::Arena(size_t size)
+    : mBuffer(new std::byte[size])
+    , mSize(size)
+    , mOffset(0)
+    , mOverflowBytes(0)
+{
+}
+
+Arena::~Arena()
+{
+}
+
+void Arena::Rewind()
+{
+  mOffset = 0;
+
+  if (mOverflowBytes == 0)
+    return;
+
+  // Make room for everything the last round needed in one block
+  mSize = 2 * (mSize + mOverflowBytes);
+  mBuffer.reset(new std::byte[mSize]);
+
+  mOverflow.clear();
+  mOverflowBytes = 0;
+}
+
+size_t Arena::Capacity() const
+{
+  return mSize;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment)
+{
+  uintptr_t base = reinterpret_cast<uintptr_t>(mBuffer.get());
+  uintptr_t start = (base + mOffset + alignment - 1) & ~(uintptr_t(alignment) - 1);
+
+  if (start + bytes <= base + mSize)
+  {
+    mOffset = start + bytes - base;
+    return reinterpret_cast<void*>(start);
+  }
+
+  mOverflow.emplace_back(new std::byte[bytes + alignment]);
+  mOverflowBytes += bytes + alignment;
+
+  uintptr_t block = reinterpret_cast<uintptr_t>(mOverflow.back().get());
+  return reinterpret_cast<void*>((block + alignment - 1) & ~(uintptr_t(alignment) - 1));
+}
+
+void Arena::do_deallocate(void* /* p */, size_t /* bytes */, size_t /* alignment */)
+{
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+  return this == &other;
+}
+
+Arena& ScratchArena()
+{
+  static thread_local Arena arena;
+  return arena;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for short lived containers. Deallocation does nothing and
+// all memory is given back at once by Rewind. Requests which do not fit are
+// served by the global allocator until the next Rewind, which then grows the
+// buffer to the largest use seen so far, so once warmed up an arena never
+// calls the global allocator again.
+class Arena : public std::pmr::memory_resource
+{
+public:
+  Arena(size_t size = 64 * 1024);
+  ~Arena();
+
+  // Everything allocated before becomes invalid
+  void Rewind();
+
+  size_t Capacity() const;
+
+private:
+  std::unique_ptr<std::byte[]> mBuffer;
+  size_t mSize;
+  size_t mOffset;
+
+  std::vector<std::unique_ptr<std::byte[]>> mOverflow;
+  size_t mOverflowBytes;
+
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Arena of the calling thread, for scratch memory which does not
+// outlive the function using it
+Arena& ScratchArena();
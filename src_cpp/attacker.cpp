@@ -4,52 +4,99 @@
 
 #include "helpers.h"
 
-Attacker::Attacker(const nlohmann::json& config, const std::vector<PDoor>& doors, const std::vector<Line> walls, SDL_Renderer* renderer)
-  : Movable(0, 0, walls, renderer)
+Attacker::Attacker(const AttackerConfig& config, const std::vector<PDoor>& doors, const NavGrid& nav, const Settings& settings)
+  : Movable(0, 0, nav, settings)
   , mDoors(doors)
   , mStaying(true)
   , mCanAttack(false)
+  , mStrategy(config.strategy)
+  , mBehaviour(config.behaviour)
+  , mStartPositions(config.positions)
 {
-  // For rand() later
-  srand (time(NULL));
-
-  int index = rand() % config["pos"].size();
-  mPos.x = config["pos"][index]["x"];
-  mPos.y = config["pos"][index]["y"];
-  mSpeed = int(config["speed"]) - 1;
+  mSpeed = config.speed - 1;
+  mAttackSpeed = config.attackSpeed - 1;
 
   SetColor(0, 0, 255);
 
-  auto behaviour = config["behaviour"];
-  auto strategy = config["strategy"];
+  mStayPeriod = config.stayPeriod;
+  mAttackPeriod = config.attackPeriod;
+  mStayTime = mStayPeriod;
+  mWaitTime = mAttackPeriod;
+}
 
-  if (behaviour == "jump")
-    mBehaviour = Behaviour::JUMP;
-  else if (behaviour == "walk")
-    mBehaviour = Behaviour::WALK;
-  else
-    throw std::runtime_error("Attacker behaviour is invalid");
-
-  if (strategy == "p-test")
-    mStrategy = Strategy::P_TEST;
-  else if (strategy == "q-test")
-    mStrategy = Strategy::Q_TEST;
-  else if (strategy == "normal")
-    mStrategy = Strategy::NORMAL;
-  else
-    throw std::runtime_error("Attacker strategy is invalid");
+Attacker::~Attacker()
+{
+  mGuards.clear();
+}
+
+void Attacker::Reset()
+{
+  Movable::Reset();
 
-  mAttackSpeed = config.contains("attack_speed") ? int(config["attack_speed"]) - 1 : mSpeed;
+  int index = mRandom->Index(mStartPositions.size());
+  mPos = mStartPositions.at(index);
+
+  mStaying = true;
+  mCanAttack = false;
+  mSelectedDoor = nullptr;
 
-  mStayPeriod = float(config["stay_period"]) * 60;
-  mAttackPeriod = float(config["attack_period"]) * 60;
   mStayTime = mStayPeriod;
   mWaitTime = mAttackPeriod;
+  mStats = DoorStats();
 }
 
-Attacker::~Attacker()
+DoorStats Attacker::GetStats() const
 {
-  mGuards.clear();
+  return mStats;
+}
+
+void Attacker::Save(Snapshot& snapshot) const
+{
+  Movable::Save(snapshot.movable);
+
+  auto it = std::find(mDoors.begin(), mDoors.end(), mSelectedDoor);
+  snapshot.selectedDoor = mSelectedDoor ? it - mDoors.begin() : -1;
+
+  snapshot.staying = mStaying;
+  snapshot.canAttack = mCanAttack;
+  snapshot.stayTime = mStayTime;
+  snapshot.waitTime = mWaitTime;
+  snapshot.stats = mStats;
+}
+
+void Attacker::Restore(const Snapshot& snapshot)
+{
+  Movable::Restore(snapshot.movable);
+
+  mSelectedDoor = snapshot.selectedDoor < 0 ? nullptr : mDoors.at(snapshot.selectedDoor);
+
+  mStaying = snapshot.staying;
+  mCanAttack = snapshot.canAttack;
+  mStayTime = snapshot.stayTime;
+  mWaitTime = snapshot.waitTime;
+  mStats = snapshot.stats;
+}
+
+void Attacker::Leave()
+{
+  mPresent = false;
+  mPoints.clear();
+  mState = State::IDLE;
+}
+
+void Attacker::Arrive(const Point& pos)
+{
+  mPresent = true;
+  mPos = pos;
+  mPoints.clear();
+  mState = State::IDLE;
+
+  // Lie low for a while before attacking the next floor
+  mStaying = true;
+  mCanAttack = false;
+  mSelectedDoor = nullptr;
+  mWaitTime = mAttackPeriod;
+  mStayTime = mStayPeriod;
 }
 
 void Attacker::StartCheck(int /* id */)
@@ -73,7 +120,7 @@ void Attacker::SelectDoor()
 
   mPoints.clear();
 
-  int index = rand() % mDoors.size();
+  int index = mRandom->Index(mDoors.size());
   mSelectedDoor = mDoors.at(index);
 }
 
@@ -95,7 +142,7 @@ void Attacker::Move(const Point& goal)
   // Count time until we try to attack
   if (mWaitTime > 0)
   {
-    --mWaitTime;
+    CountDown(mWaitTime, mSettings.timeStep);
   }
   else if (mStrategy != Strategy::Q_TEST)
   {
@@ -105,7 +152,7 @@ void Attacker::Move(const Point& goal)
 
   if (mStaying && mStayTime > 0)
   {
-    --mStayTime;
+    CountDown(mStayTime, mSettings.timeStep);
     return;
   }
 
@@ -115,7 +162,7 @@ void Attacker::Move(const Point& goal)
 
   if (mSelectedDoor && mCanAttack)
   {
-    if (ToWorld(mPos) != ToWorld(mSelectedDoor->Pos()))
+    if (ToWorld(mPos, mSettings.tileSize) != ToWorld(mSelectedDoor->Pos(), mSettings.tileSize))
     {
       Movable::Move(mSelectedDoor->Pos());
     }
@@ -123,9 +170,16 @@ void Attacker::Move(const Point& goal)
     {
       if (mSelectedDoor->Enter())
       {
-        if (mStrategy != Strategy::P_TEST)
+        ++mStats.successes;
+        if (mSelectedDoor->ToNextLevel() && mChangeFloor)
+          mChangeFloor(mSelectedDoor->ToFloor(), mSelectedDoor->ToDoor());
+        else if (mStrategy != Strategy::P_TEST)
           mReachedDoor();
       }
+      else
+      {
+        ++mStats.failures;
+      }
 
       mStaying = true;
       mCanAttack = false;
@@ -139,7 +193,11 @@ void Attacker::Move(const Point& goal)
   {
     // Take guard locations into account and try to avoid them
     if (mPoints.empty())
-      mPoints = PathFinding(mPos, goal, mWalls, mGuards);
+    {
+      PathFinding(mPos, goal, mNav, mGuards, mPoints);
+      if (!mPoints.empty())
+        ++mPathsFound;
+    }
     else
       Movable::Move(goal);
   }
@@ -4,8 +4,7 @@
 #include <memory>
 #include <vector>
 
-#include <nlohmann/json.hpp>
-
+#include "blueprint.h"
 #include "door.h"
 #include "guard.h"
 #include "movable.h"
@@ -14,36 +13,54 @@
 class Attacker : public Movable
 {
 public:
-  Attacker(const nlohmann::json& config, const std::vector<PDoor>& doors, const std::vector<Line> walls, SDL_Renderer* renderer);
+  Attacker(const AttackerConfig& config, const std::vector<PDoor>& doors, const NavGrid& nav, const Settings& settings);
   ~Attacker();
 
   void Move(const Point& goal) override;
+  void Reset() override;
   void StartCheck(int id) override;
 
   void SetGuards(const std::vector<PGuard>& guards);
 
+  // Go to another floor through an open door, and come in on the new floor
+  void Leave();
+  void Arrive(const Point& pos);
+
+  std::function<void(int32_t floor, int32_t door)> mChangeFloor;
+
+  // Doors this attacker tried to enter since the last reset
+  DoorStats GetStats() const;
+
+  struct Snapshot
+  {
+    Movable::Snapshot movable;
+
+    int selectedDoor = -1;  // Index into the doors given on construction
+    bool staying = true;
+    bool canAttack = false;
+    uint32_t stayTime = 0;
+    uint32_t waitTime = 0;
+    DoorStats stats;
+  };
+
+  void Save(Snapshot& snapshot) const;
+  void Restore(const Snapshot& snapshot);
+
   std::function<void()> mReachedDoor;
   std::function<void()> mWasCaught;
 
 private:
+  using Strategy = AttackerConfig::Strategy;
+  using Behaviour = AttackerConfig::Behaviour;
+
   PDoor mSelectedDoor;
   std::vector<PDoor> mDoors;
 
   bool mStaying;
   bool mCanAttack;
 
-  enum class Strategy
-  {
-    P_TEST,
-    Q_TEST,
-    NORMAL
-  } mStrategy;
-
-  enum class Behaviour
-  {
-    WALK,
-    JUMP
-  } mBehaviour;
+  Strategy mStrategy;
+  Behaviour mBehaviour;
 
   int mAttackSpeed;
 
@@ -52,6 +69,10 @@ private:
   uint32_t mWaitTime;
   uint32_t mAttackPeriod;
 
+  std::vector<Point> mStartPositions;
+
+  DoorStats mStats;
+
   std::vector<PGuard> mGuards;
 
   void SelectDoor();
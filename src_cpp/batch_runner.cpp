@@ -0,0 +1,112 @@
+#include "batch_runner.h"
+
+#include <algorithm>
+
+#include "simulation.h"
+
+BatchRunner::BatchRunner(uint32_t threads)
+    : mThreads(std::max<uint32_t>(threads, 1))
+    , mNext(0)
+    , mCollected(0)
+    , mStop(false)
+    , mHasDeadline(false)
+{
+}
+
+BatchRunner::~BatchRunner()
+{
+  Stop();
+}
+
+void BatchRunner::Add(const Blueprint& blueprint, const Args& args, uint32_t batch, uint32_t iterations)
+{
+  Job job;
+  job.blueprint = &blueprint;
+  job.args = args;
+  job.batch = batch;
+  job.iterations = iterations;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  mJobs.push_back(std::move(job));
+  mQueued.notify_one();
+}
+
+void BatchRunner::Start()
+{
+  for (uint32_t i = 0; i < mThreads; ++i)
+    mWorkers.emplace_back(&BatchRunner::Work, this);
+}
+
+void BatchRunner::SetDeadline(std::chrono::steady_clock::time_point deadline)
+{
+  mHasDeadline = true;
+  mDeadline = deadline;
+}
+
+BatchRunner::Batch BatchRunner::Next()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (mCollected >= mJobs.size())
+    return Batch();
+
+  Job& job = mJobs[mCollected++];
+  mDone.wait(lock, [&job]{ return job.done; });
+
+  return std::move(job.result);
+}
+
+void BatchRunner::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+    mQueued.notify_all();
+  }
+
+  for (auto& worker : mWorkers)
+    worker.join();
+
+  mWorkers.clear();
+}
+
+bool BatchRunner::IsPastDeadline() const
+{
+  return mHasDeadline && std::chrono::steady_clock::now() >= mDeadline;
+}
+
+void BatchRunner::Work()
+{
+  while (true)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQueued.wait(lock, [this]{ return mStop || mNext < mJobs.size(); });
+    if (mStop)
+      return;
+
+    Job& job = mJobs[mNext++];
+    lock.unlock();
+
+    const Blueprint& blueprint = *job.blueprint;
+
+    Batch result;
+    result.stats = std::make_unique<Statistics>(blueprint.testType, blueprint.dayDuration, 1, job.iterations);
+    result.stats->KeepSamples(job.args.keepSamples);
+
+    Simulation simulation(blueprint, job.batch);
+    result.ok = simulation.Init(job.args);
+    if (result.ok && !IsPastDeadline())
+    {
+      if (mHasDeadline)
+        simulation.mFrame = [this]{ return !IsPastDeadline(); };
+
+      result.finished = simulation.RunBatch(job.iterations, *result.stats);
+    }
+
+    result.allocations = simulation.TickAllocations();
+
+    lock.lock();
+    job.result = std::move(result);
+    job.done = true;
+    mDone.notify_all();
+  }
+}
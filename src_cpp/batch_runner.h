@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "blueprint.h"
+#include "settings.h"
+#include "statistics.h"
+
+// Simulates whole batches on a fixed set of threads, each batch with a
+// simulation of its own. Batches are handed back in the order they were
+// added, whatever order they finish in, so results that are merged as they
+// come back do not depend on the number of threads.
+class BatchRunner
+{
+public:
+  BatchRunner(uint32_t threads);
+  ~BatchRunner();
+
+  // Queue a batch, also while running. The blueprint has to stay alive
+  // until the batch is collected
+  void Add(const Blueprint& blueprint, const Args& args, uint32_t batch, uint32_t iterations);
+
+  // Start simulating everything added so far, and whatever is added later
+  void Start();
+
+  // Batches still running at the deadline are stopped and later ones are
+  // skipped, only before Start
+  void SetDeadline(std::chrono::steady_clock::time_point deadline);
+
+  struct Batch
+  {
+    std::unique_ptr<Statistics> stats;
+    uint64_t allocations = 0;
+    bool ok = false;        // False if the simulation could not be set up
+    bool finished = false;  // False if the deadline came first
+  };
+
+  // Wait for the next batch in the order they were added
+  Batch Next();
+
+  // Skip the batches which have not started yet and wait for the others
+  void Stop();
+
+private:
+  struct Job
+  {
+    const Blueprint* blueprint = nullptr;
+    Args args;
+    uint32_t batch = 0;
+    uint32_t iterations = 0;
+
+    Batch result;
+    bool done = false;
+  };
+
+  uint32_t mThreads;
+  std::vector<std::thread> mWorkers;
+
+  // A deque keeps jobs in place while more are added
+  std::deque<Job> mJobs;
+  uint32_t mNext;
+  uint32_t mCollected;
+  bool mStop;
+
+  bool mHasDeadline;
+  std::chrono::steady_clock::time_point mDeadline;
+
+  std::mutex mMutex;
+  std::condition_variable mQueued;
+  std::condition_variable mDone;
+
+  void Work();
+  bool IsPastDeadline() const;
+};
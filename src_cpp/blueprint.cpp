@@ -0,0 +1,313 @@
+#include "blueprint.h"
+
+#include <iostream>
+
+#include "helpers.h"
+
+using json = nlohmann::json;
+
+Blueprint::Blueprint()
+    : observedMean(0.0)
+    , fps(0)
+    , iterations(0)
+    , cyclesPerFrame(0)
+    , dayDuration(0)
+    , tileSize(0)
+    , width(0)
+    , height(0)
+{
+}
+
+Blueprint::~Blueprint()
+{
+}
+
+bool Blueprint::Init(const nlohmann::json& config)
+{
+  return Init(config, nullptr);
+}
+
+bool Blueprint::Init(const nlohmann::json& config, const PNavGrid& shared)
+{
+  try
+  {
+    level = config["level"];
+    testType = config["test_type"];
+    observedMean = float(config["observed_mean"]);
+
+    fps = uint32_t(config["fps"]);
+    iterations = uint32_t(config["iterations"]);
+    cyclesPerFrame = uint32_t(config["cycles_per_frame"]);
+    dayDuration = uint32_t(config["day_duration"]);
+
+    tileSize = uint32_t(config["tile_size"]);
+    width = float(config["width"]) * tileSize;
+    height = float(config["height"]) * tileSize;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  LOG_AND_RETURN_ON_FAILURE(ParseWalls(config["walls"]), "Failed to parse walls");
+  LOG_AND_RETURN_ON_FAILURE(ParseDoors(config["doors"]), "Failed to parse doors");
+  LOG_AND_RETURN_ON_FAILURE(ParseAttacker(config["attacker"]), "Failed to parse attacker");
+  LOG_AND_RETURN_ON_FAILURE(ParseEmployees(config["employees"]), "Failed to parse employees");
+  LOG_AND_RETURN_ON_FAILURE(ParseGuards(config["guards"]), "Failed to parse guards");
+
+  if (shared && shared->Matches(width, height, tileSize, walls))
+  {
+    navigation = shared;
+    return true;
+  }
+
+  return BuildNavigation();
+}
+
+bool Blueprint::InitBuilding(const nlohmann::json& config, const std::vector<Blueprint>& floorBlueprints)
+{
+  LOG_AND_RETURN_ON_FAILURE(!floorBlueprints.empty(), "Building has no floors");
+
+  auto linked = floorBlueprints;
+  for (const auto& floor : linked)
+    LOG_AND_RETURN_ON_FAILURE(floor.tileSize == linked[0].tileSize, "All floors of a building need the same tile size");
+
+  try
+  {
+    for (auto& link : config["links"])
+    {
+      uint32_t floor = link["floor"];
+      uint32_t door = link["door"];
+      uint32_t toFloor = link["to_floor"];
+      uint32_t toDoor = link["to_door"];
+
+      if (floor >= linked.size() || door >= linked[floor].doors.size() ||
+          toFloor >= linked.size() || toDoor >= linked[toFloor].doors.size())
+        throw std::runtime_error("Building link to a missing floor or door");
+
+      linked[floor].doors[door].toFloor = toFloor;
+      linked[floor].doors[door].toDoor = toDoor;
+    }
+
+    *this = linked[0];
+    floors = linked;
+
+    level = config["level"];
+    testType = config["test_type"];
+    observedMean = float(config["observed_mean"]);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool Blueprint::BuildNavigation()
+{
+  auto grid = std::make_shared<NavGrid>();
+  LOG_AND_RETURN_ON_FAILURE(grid->Build(width, height, tileSize, walls), "Failed to build navigation grid");
+
+  navigation = grid;
+  return true;
+}
+
+bool Blueprint::ParseWalls(const nlohmann::json& config)
+{
+  try
+  {
+    for (auto& line : config)
+    {
+      walls.push_back(Line(line["x1"], line["y1"], line["x2"], line["y2"]));
+      bool hasX = line.contains("dead_x");
+      bool hasY = line.contains("dead_y");
+      if (!hasX && !hasY)
+        continue;
+
+      if (hasX)
+      {
+        walls.back().deadzone.x = line["dead_x"] == "right" ? float(line["x1"]) : 0;
+        walls.back().deadzone.w = line["dead_x"] == "right" ? width - float(line["x1"]) : float(line["x1"]);
+      }
+      else
+      {
+        walls.back().deadzone.x = float(line["x1"]);
+        walls.back().deadzone.w = float(line["x2"]) - float(line["x1"]);
+      }
+
+      if (hasY)
+      {
+        walls.back().deadzone.y = line["dead_y"] == "bottom" ? float(line["y1"]) : 0;
+        walls.back().deadzone.h = line["dead_y"] == "bottom" ? height - float(line["y1"]) : float(line["y2"]);
+      }
+      else
+      {
+        walls.back().deadzone.y = float(line["y1"]);
+        walls.back().deadzone.h = float(line["y2"]) - float(line["y1"]);
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool Blueprint::ParseDoors(const nlohmann::json& config)
+{
+  try
+  {
+    for (auto& c : config)
+    {
+      DoorConfig door;
+      door.x = float(c["x"]);
+      door.y = float(c["y"]);
+
+      door.maxOpenTime = float(c["max_open_time"]) * 60;
+      door.minOpenTime = float(c["min_open_time"]) * 60;
+      door.maxShortOpenTime = float(c["max_short_open_time"]) * 60;
+      door.minShortOpenTime = float(c["min_short_open_time"]) * 60;
+      door.interOpeningDuration = float(c["inter_opening_time"]) * 60;
+      door.interOpeningDeviation = c.contains("inter_opening_deviation") ? float(c["inter_opening_deviation"]) * 60 : 1;
+
+      door.shortOpeningProbability = 100 * float(c["short_opening_probability"]);
+
+      doors.push_back(door);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool Blueprint::ParseGuards(const nlohmann::json& config)
+{
+  try
+  {
+    uint32_t index = 0;
+    uint32_t nGuards = config["number_of_guards"];
+    if (nGuards > 0 && config["config"].empty())
+      throw std::runtime_error("Guards are requested but their config is empty");
+
+    for (uint32_t i = 0; i < nGuards; ++i)
+    {
+      index = config["config"].size() == 1 ? 0 : index;
+      auto& c = config["config"].at(index);
+
+      GuardConfig guard;
+      guard.checkSpeed = float(c["check_speed"]);
+      guard.strollSpeed = float(c["stroll_speed"]);
+      guard.checkRadius = float(c["check_radius"]);
+
+      auto behaviour = c["behaviour"];
+      if (behaviour == "stroll")
+        guard.behaviour = GuardConfig::Behaviour::STROLL;
+      else if (behaviour == "reset")
+        guard.behaviour = GuardConfig::Behaviour::RESET;
+      else
+        throw std::runtime_error("Guard behaviour is invalid");
+
+      guard.maxCheckTime = float(c["max_check_time"]) * 60;
+      guard.minCheckTime = float(c["min_check_time"]) * 60;
+      guard.maxMissionTime = float(c["max_mission_time"]) * 60;
+      guard.minMissionTime = float(c["min_mission_time"]) * 60;
+      guard.numberOfMissions = float(c["number_of_missions"]);
+
+      guard.entitiesPerCheck = uint32_t(c["entities_per_check"]);
+
+      guards.push_back(guard);
+      index++;
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool Blueprint::ParseAttacker(const nlohmann::json& config)
+{
+  try
+  {
+    for (auto& p : config["pos"])
+      attacker.positions.push_back(Point(p["x"], p["y"]));
+
+    if (attacker.positions.empty())
+      throw std::runtime_error("Attacker has no starting positions");
+
+    attacker.speed = int(config["speed"]);
+    attacker.attackSpeed = config.contains("attack_speed") ? int(config["attack_speed"]) : attacker.speed;
+
+    auto behaviour = config["behaviour"];
+    auto strategy = config["strategy"];
+
+    if (behaviour == "jump")
+      attacker.behaviour = AttackerConfig::Behaviour::JUMP;
+    else if (behaviour == "walk")
+      attacker.behaviour = AttackerConfig::Behaviour::WALK;
+    else
+      throw std::runtime_error("Attacker behaviour is invalid");
+
+    if (strategy == "p-test")
+      attacker.strategy = AttackerConfig::Strategy::P_TEST;
+    else if (strategy == "q-test")
+      attacker.strategy = AttackerConfig::Strategy::Q_TEST;
+    else if (strategy == "normal")
+      attacker.strategy = AttackerConfig::Strategy::NORMAL;
+    else
+      throw std::runtime_error("Attacker strategy is invalid");
+
+    attacker.stayPeriod = float(config["stay_period"]) * 60;
+    attacker.attackPeriod = float(config["attack_period"]) * 60;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool Blueprint::ParseEmployees(const nlohmann::json& config)
+{
+  try
+  {
+    employees.count = uint32_t(config["number_of_employees"]);
+
+    // Levels without employees do not need to describe them
+    if (employees.count == 0)
+      return true;
+
+    auto behaviour = config["behaviour"];
+    if (behaviour == "stay")
+      employees.behaviour = EmployeeConfig::Behaviour::STAY;
+    else if (behaviour == "walk")
+      employees.behaviour = EmployeeConfig::Behaviour::WALK;
+    else
+      throw std::runtime_error("Employee behaviour is invalid");
+
+    employees.maxStayTime = float(config["max_stay_time"]) * 60;
+    employees.minStayTime = float(config["min_stay_time"]) * 60;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
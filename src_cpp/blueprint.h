@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "navigation.h"
+#include "settings.h"
+
+// Typed view of a level configuration. The JSON file is read once into
+// these structures and every entity is built (and reset) from them, so
+// no string lookups happen between iterations.
+// All durations are stored in ticks and all lengths in tiles unless noted.
+
+struct DoorConfig
+{
+  float x = 0.0;  // Fraction of the level width
+  float y = 0.0;  // Fraction of the level height
+
+  float interOpeningDuration = 0.0;
+  float interOpeningDeviation = 0.0;
+  float minShortOpenTime = 0.0;
+  float maxShortOpenTime = 0.0;
+  float minOpenTime = 0.0;
+  float maxOpenTime = 0.0;
+
+  uint32_t shortOpeningProbability = 0;  // In percent
+
+  // Door on another floor of the building this one leads to, -1 if none
+  int32_t toFloor = -1;
+  int32_t toDoor = -1;
+};
+
+struct GuardConfig
+{
+  enum class Behaviour
+  {
+    STROLL,
+    RESET
+  } behaviour = Behaviour::STROLL;
+
+  float checkSpeed = 0.0;
+  float strollSpeed = 0.0;
+  float checkRadius = 0.0;
+
+  float minCheckTime = 0.0;
+  float maxCheckTime = 0.0;
+  float minMissionTime = 0.0;
+  float maxMissionTime = 0.0;
+  float numberOfMissions = 0.0;
+
+  uint32_t entitiesPerCheck = 0;
+};
+
+struct EmployeeConfig
+{
+  enum class Behaviour
+  {
+    STAY,
+    WALK
+  } behaviour = Behaviour::WALK;
+
+  uint32_t count = 0;
+
+  float minStayTime = 0.0;
+  float maxStayTime = 0.0;
+};
+
+struct AttackerConfig
+{
+  enum class Strategy
+  {
+    P_TEST,
+    Q_TEST,
+    NORMAL
+  } strategy = Strategy::NORMAL;
+
+  enum class Behaviour
+  {
+    WALK,
+    JUMP
+  } behaviour = Behaviour::WALK;
+
+  std::vector<Point> positions;  // In pixels
+
+  int speed = 1;
+  int attackSpeed = 1;
+
+  float stayPeriod = 0.0;
+  float attackPeriod = 0.0;
+};
+
+class Blueprint
+{
+public:
+  Blueprint();
+  ~Blueprint();
+
+  bool Init(const nlohmann::json& config);
+
+  // Same as Init, but keeps using navigation if it was built from the same
+  // walls and dimensions, which skips the expensive part of loading a level
+  bool Init(const nlohmann::json& config, const PNavGrid& navigation);
+
+  // A building is a list of floors linked through some of their doors. The
+  // simulation settings come from the first floor, where the attacker starts
+  bool InitBuilding(const nlohmann::json& config, const std::vector<Blueprint>& floorBlueprints);
+
+  std::string level;
+  std::string testType;
+  float observedMean;
+
+  uint32_t fps;
+  uint32_t iterations;
+  uint32_t cyclesPerFrame;
+  uint32_t dayDuration;
+
+  // Level dimensions in pixels
+  uint32_t tileSize;
+  uint32_t width;
+  uint32_t height;
+
+  std::vector<Line> walls;
+  std::vector<DoorConfig> doors;
+  std::vector<GuardConfig> guards;  // One entry per guard
+  EmployeeConfig employees;
+  AttackerConfig attacker;
+
+  // Derived from the walls, shared by every level built from this blueprint
+  PNavGrid navigation;
+
+  // Only used by buildings
+  std::vector<Blueprint> floors;
+
+  bool BuildNavigation();
+
+private:
+  bool ParseWalls(const nlohmann::json& config);
+  bool ParseDoors(const nlohmann::json& config);
+  bool ParseGuards(const nlohmann::json& config);
+  bool ParseAttacker(const nlohmann::json& config);
+  bool ParseEmployees(const nlohmann::json& config);
+};
@@ -0,0 +1,110 @@
+#include "building.h"
+
+#include "helpers.h"
+
+Building::Building(const Blueprint& blueprint, const Settings& settings)
+    : mBlueprint(blueprint)
+    , mSettings(settings)
+    , mPool(nullptr)
+    , mFloor(0)
+    , mNextFloor(-1)
+    , mNextDoor(-1)
+    , mRunning(false)
+    , mResult(false)
+{
+}
+
+Building::~Building()
+{
+}
+
+bool Building::Init(ThreadPool* pool)
+{
+  mPool = pool;
+
+  for (const auto& floor : mBlueprint.floors)
+  {
+    // Every floor keeps its own dimensions, the rest is shared
+    Settings settings = mSettings;
+    settings.width = floor.width;
+    settings.height = floor.height;
+
+    auto level = std::make_unique<Level>(settings);
+    level->mReachedDoor = [this]{ Finished(true); };
+    level->mWasCaught = [this]{ Finished(false); };
+    level->mChangeFloor = [this](int32_t floor, int32_t door)
+    {
+      mNextFloor = floor;
+      mNextDoor = door;
+    };
+
+    LOG_AND_RETURN_ON_FAILURE(level->Init(floor), "Failed to create floor");
+    mFloors.push_back(std::move(level));
+  }
+
+  return true;
+}
+
+void Building::Finished(bool result)
+{
+  mRunning = false;
+  mResult = result;
+}
+
+Result Building::Run(uint32_t totalTicks, uint64_t key)
+{
+  for (uint32_t i = 0; i < mFloors.size(); ++i)
+  {
+    mFloors[i]->Reseed(Randomizer::Key(key, i));
+    mFloors[i]->Reset();
+    if (i != 0)
+      mFloors[i]->AttackerLeft();
+  }
+
+  mFloor = 0;
+  mNextFloor = -1;
+  mRunning = true;
+  mResult = false;
+
+  uint32_t ticks = 0;
+  while (mRunning)
+  {
+    if (ticks >= totalTicks)
+    {
+      Finished(true);
+      break;
+    }
+
+    // Only the floor with the attacker can end the iteration or ask for a
+    // floor change, so the floors never write the same state
+    if (mPool)
+    {
+      mPool->ParallelFor(mFloors.size(), [this](uint32_t i){ mFloors[i]->Run(); });
+    }
+    else
+    {
+      for (auto& floor : mFloors)
+        floor->Run();
+    }
+
+    ticks += mSettings.timeStep;
+
+    if (mNextFloor < 0)
+      continue;
+
+    mFloors[mFloor]->AttackerLeft();
+    mFloor = mNextFloor;
+    mFloors[mFloor]->AttackerArrived(mNextDoor);
+    mNextFloor = -1;
+  }
+
+  DoorStats stats;
+  for (auto& floor : mFloors)
+  {
+    auto s = floor->GetResult();
+    stats.successes += s.successes;
+    stats.failures += s.failures;
+  }
+
+  return Result{mResult, float(ticks) / 60, stats};
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "blueprint.h"
+#include "level.h"
+#include "settings.h"
+#include "thread_pool.h"
+
+// Several floors, each one a level of its own, simulated as one site.
+// Floors only affect each other when the attacker goes through a door
+// leading to another floor, which is applied between ticks, so within a
+// tick every floor can be updated independently from the others.
+class Building
+{
+public:
+  Building(const Blueprint& blueprint, const Settings& settings);
+  ~Building();
+
+  bool Init(ThreadPool* pool);
+
+  // Simulate the iteration given by key, the attacker starts on the first floor
+  Result Run(uint32_t totalTicks, uint64_t key);
+
+private:
+  const Blueprint& mBlueprint;
+  const Settings mSettings;
+  ThreadPool* mPool;
+
+  std::vector<std::unique_ptr<Level>> mFloors;
+
+  uint32_t mFloor;       // Floor the attacker is on
+  int32_t mNextFloor;    // Floor it is going to, -1 if it stays
+  int32_t mNextDoor;
+
+  bool mRunning;
+  bool mResult;
+
+  void Finished(bool result);
+};
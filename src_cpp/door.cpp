@@ -1,34 +1,26 @@
 #include "door.h"
 
 #include <iostream>
-#include <random>
 
-Door::Door(uint32_t id, const nlohmann::json& config, SDL_Renderer* renderer)
-    : mRenderer(renderer)
+#include "helpers.h"
+
+Door::Door(uint32_t id, const DoorConfig& config, const Settings& settings)
+    : mSettings(settings)
     , mId(id)
+    , mToFloor(config.toFloor)
+    , mToDoor(config.toDoor)
     , mIsOpen(false)
-    , mIsNextLevel(true)
     , mWaitTime(0)
+    , mShortOpeningProbability(config.shortOpeningProbability)
 {
-  srand (time(NULL));
-
-  mPos.x = float(config["x"]) * WIDTH;
-  mPos.y = float(config["y"]) * HEIGHT;
-
-  CreateArea(config["direction"]);
+  mPos.x = config.x * mSettings.width;
+  mPos.y = config.y * mSettings.height;
 
-  float maxOpenTime = float(config["max_open_time"]) * 60;
-  float minOpenTime = float(config["min_open_time"]) * 60;
-  float maxShortOpenTime = float(config["max_short_open_time"]) * 60;
-  float minShortOpenTime = float(config["min_short_open_time"]) * 60;
-  float interOpeningDuration = float(config["inter_opening_time"]) * 60;
-  float interOpeningDeviation = config.contains("inter_opening_deviation") ? float(config["inter_opening_deviation"]) * 60 : 1;
+  CreateArea();
 
-  mShortOpeningProbability = 100 * float(config["short_opening_probability"]);
-
-  mClosingRandom = std::make_unique<Randomizer>(interOpeningDuration, interOpeningDeviation);
-  mShortOpeningRandom = std::make_unique<Randomizer>(minShortOpenTime, maxShortOpenTime);
-  mLongOpeningRandom = std::make_unique<Randomizer>(minOpenTime, maxOpenTime);
+  mClosingRandom = std::make_unique<Randomizer>(config.interOpeningDuration, config.interOpeningDeviation);
+  mShortOpeningRandom = std::make_unique<Randomizer>(config.minShortOpenTime, config.maxShortOpenTime);
+  mLongOpeningRandom = std::make_unique<Randomizer>(config.minOpenTime, config.maxOpenTime);
 }
 
 Door::~Door()
@@ -50,27 +42,70 @@ Point Door::Pos() const
   return mPos;
 }
 
+Rect Door::Area() const
+{
+  return mRect;
+}
+
 DoorStats Door::GetStats() const
 {
   return mStats;
 }
 
-void Door::CreateArea(const std::string& direction)
+void Door::Reset()
+{
+  mIsOpen = false;
+  mWaitTime = 0;
+  mStats = DoorStats();
+}
+
+void Door::Save(Snapshot& snapshot) const
+{
+  snapshot.isOpen = mIsOpen;
+  snapshot.waitTime = mWaitTime;
+  snapshot.stats = mStats;
+
+  snapshot.closingRandom = mClosingRandom->Save();
+  snapshot.shortOpeningRandom = mShortOpeningRandom->Save();
+  snapshot.longOpeningRandom = mLongOpeningRandom->Save();
+}
+
+void Door::Restore(const Snapshot& snapshot)
+{
+  mIsOpen = snapshot.isOpen;
+  mWaitTime = snapshot.waitTime;
+  mStats = snapshot.stats;
+
+  mClosingRandom->Restore(snapshot.closingRandom);
+  mShortOpeningRandom->Restore(snapshot.shortOpeningRandom);
+  mLongOpeningRandom->Restore(snapshot.longOpeningRandom);
+}
+
+void Door::Reseed(uint64_t key, bool mirrored)
 {
-  if (mPos.x + HALF_TILE >= WIDTH)
-    mPos.x -= HALF_TILE;
-  else if (mPos.x - HALF_TILE <= 0)
-    mPos.x += HALF_TILE;
+  mClosingRandom->Seed(Randomizer::Key(key, 0), mirrored);
+  mShortOpeningRandom->Seed(Randomizer::Key(key, 1), mirrored);
+  mLongOpeningRandom->Seed(Randomizer::Key(key, 2), mirrored);
+}
+
+void Door::CreateArea()
+{
+  const uint32_t halfTile = mSettings.halfTile;
+
+  if (mPos.x + halfTile >= mSettings.width)
+    mPos.x -= halfTile;
+  else if (mPos.x - halfTile <= 0)
+    mPos.x += halfTile;
 
-  if (mPos.y + HALF_TILE >= HEIGHT)
-    mPos.y -= HALF_TILE;
-  else if (mPos.y - HALF_TILE <= 0)
-    mPos.y += HALF_TILE;
+  if (mPos.y + halfTile >= mSettings.height)
+    mPos.y -= halfTile;
+  else if (mPos.y - halfTile <= 0)
+    mPos.y += halfTile;
 
-  mRect.x = mPos.x - HALF_TILE;
-  mRect.y = mPos.y - HALF_TILE;
-  mRect.w = TILE_SIZE;
-  mRect.h = TILE_SIZE;
+  mRect.x = mPos.x - halfTile;
+  mRect.y = mPos.y - halfTile;
+  mRect.w = mSettings.tileSize;
+  mRect.h = mSettings.tileSize;
 
 }
 
@@ -95,7 +130,17 @@ bool Door::IsOpen() const
 
 bool Door::ToNextLevel() const
 {
-  return true;
+  return mToFloor >= 0;
+}
+
+int32_t Door::ToFloor() const
+{
+  return mToFloor;
+}
+
+int32_t Door::ToDoor() const
+{
+  return mToDoor;
 }
 
 void Door::React()
@@ -103,7 +148,7 @@ void Door::React()
   // Check how long the door has been in current state
   if (mWaitTime > 0)
   {
-    --mWaitTime;
+    CountDown(mWaitTime, mSettings.timeStep);
     return;
   }
 
@@ -115,7 +160,7 @@ void Door::React()
   else
   {
     // Check if the door should open for a short or long time
-    if ((rand() % 100 + 1) <= mShortOpeningProbability)
+    if ((mShortOpeningRandom->Index(100) + 1) <= mShortOpeningProbability)
       mWaitTime = mShortOpeningRandom->Uniform();
     else
       mWaitTime = mLongOpeningRandom->Uniform();
@@ -127,14 +172,4 @@ void Door::React()
 void Door::Update()
 {
   React();
-
-  if (HIDDEN)
-    return;
-
-  if (IsOpen())
-    SDL_SetRenderDrawColor(mRenderer, 0, 255, 0, 255);
-  else
-    SDL_SetRenderDrawColor(mRenderer, 255, 0, 0, 255);
-
-  SDL_RenderDrawRect(mRenderer, &mRect);
 }
\ No newline at end of file
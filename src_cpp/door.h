@@ -2,16 +2,14 @@
 
 #include <memory>
 
-#include <SDL2/SDL.h>
-#include <nlohmann/json.hpp>
-
+#include "blueprint.h"
 #include "randomizer.h"
 #include "settings.h"
 
 class Door
 {
 public:
-  Door(uint32_t id, const nlohmann::json& config, SDL_Renderer* renderer);
+  Door(uint32_t id, const DoorConfig& config, const Settings& settings);
   ~Door();
 
   float X() const;
@@ -19,22 +17,46 @@ public:
 
   Point Pos() const;
 
+  // Tile covered by the door
+  Rect Area() const;
+
   void Update();
+  void Reset();
 
   DoorStats GetStats() const;
 
   bool Enter();
   bool IsOpen() const;
+  // True if entering leads to another floor, given by ToFloor and ToDoor
   bool ToNextLevel() const;
+  int32_t ToFloor() const;
+  int32_t ToDoor() const;
+
+  struct Snapshot
+  {
+    bool isOpen = false;
+    uint32_t waitTime = 0;
+    DoorStats stats;
+
+    Randomizer::State closingRandom;
+    Randomizer::State shortOpeningRandom;
+    Randomizer::State longOpeningRandom;
+  };
+
+  void Save(Snapshot& snapshot) const;
+  void Restore(const Snapshot& snapshot);
+  void Reseed(uint64_t key, bool mirrored);
 
 private:
-  SDL_Renderer* mRenderer;
+  const Settings& mSettings;
 
   Point mPos;
-  SDL_Rect mRect;
+  Rect mRect;
 
   const uint32_t mId;
-  const bool mIsNextLevel;
+  const int32_t mToFloor;
+  const int32_t mToDoor;
+
   bool mIsOpen;
 
   DoorStats mStats;
@@ -47,7 +69,7 @@ private:
   std::unique_ptr<Randomizer> mLongOpeningRandom;
 
   void React();
-  void CreateArea(const std::string& direction);
+  void CreateArea();
 };
 
 typedef std::shared_ptr<Door> PDoor;
\ No newline at end of file
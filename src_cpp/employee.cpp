@@ -1,37 +1,55 @@
 #include "employee.h"
 
-Employee::Employee(uint32_t id, const nlohmann::json& config, const std::vector<Line> walls, SDL_Renderer* renderer)
-    : Movable(0, 0, walls, renderer)
+#include "helpers.h"
+
+Employee::Employee(uint32_t id, const EmployeeConfig& config, const NavGrid& nav, const Settings& settings)
+    : Movable(0, 0, nav, settings)
     , mId(id)
     , mWaitTime(0)
+    , mBehaviour(config.behaviour)
 {
-  mPos = GetRandomPoint();
-
   SetColor(0, 120, 50);
 
-  auto behaviour = config["behaviour"];
-  if (behaviour == "stay")
-    mBehaviour = Behaviour::STAY;
-  else if (behaviour == "walk")
-    mBehaviour = Behaviour::WALK;
-  else
-    throw std::runtime_error("Employee behaviour is invalid");
+  mRandomWait = std::make_unique<Randomizer>(config.minStayTime, config.maxStayTime);
+}
 
-  float maxStayTime = float(config["max_stay_time"]) * 60;
-  float minStayTime = float(config["min_stay_time"]) * 60;
+Employee::~Employee()
+{
+}
+
+void Employee::Reset()
+{
+  Movable::Reset();
 
-  mRandomWait = std::make_unique<Randomizer>(minStayTime, maxStayTime);
+  mPos = GetRandomPoint();
+  mWaitTime = 0;
 }
 
-Employee::~Employee()
+void Employee::Save(Snapshot& snapshot) const
+{
+  Movable::Save(snapshot.movable);
+  snapshot.waitTime = mWaitTime;
+  snapshot.randomWait = mRandomWait->Save();
+}
+
+void Employee::Restore(const Snapshot& snapshot)
+{
+  Movable::Restore(snapshot.movable);
+  mWaitTime = snapshot.waitTime;
+  mRandomWait->Restore(snapshot.randomWait);
+}
+
+void Employee::Reseed(uint64_t key, bool mirrored)
 {
+  Movable::Reseed(key, mirrored);
+  mRandomWait->Seed(Randomizer::Key(key, 3), mirrored);
 }
 
 void Employee::Move(const Point& goal)
 {
   if (mWaitTime)
   {
-    --mWaitTime;
+    CountDown(mWaitTime, mSettings.timeStep);
     return;
   }
 
@@ -2,30 +2,39 @@
 
 #include <memory>
 
-#include <nlohmann/json.hpp>
-
+#include "blueprint.h"
 #include "movable.h"
 #include "randomizer.h"
 
 class Employee : public Movable
 {
 public:
-  Employee(uint32_t id, const nlohmann::json& config, const std::vector<Line> walls, SDL_Renderer* renderer);
+  Employee(uint32_t id, const EmployeeConfig& config, const NavGrid& nav, const Settings& settings);
   ~Employee();
 
   void Move(const Point& goal) override;
+  void Reset() override;
+
+  struct Snapshot
+  {
+    Movable::Snapshot movable;
+    uint32_t waitTime = 0;
+    Randomizer::State randomWait;
+  };
+
+  void Save(Snapshot& snapshot) const;
+  void Restore(const Snapshot& snapshot);
+  void Reseed(uint64_t key, bool mirrored) override;
 
 private:
+  using Behaviour = EmployeeConfig::Behaviour;
+
   uint32_t mId;
   uint32_t mWaitTime;
 
-  enum class Behaviour
-  {
-    STAY,
-    WALK
-  } mBehaviour;
+  Behaviour mBehaviour;
 
   std::unique_ptr<Randomizer> mRandomWait;
 };
 
-typedef std::shared_ptr<Employee> PEmployee;
\ No newline at end of file
+typedef std::shared_ptr<Employee> PEmployee;
@@ -1,40 +1,122 @@
 #include "game.h"
 
 #include <stdio.h>
+#include <thread>
 
 #include "SDL_image.h"
 
 #include "helpers.h"
-#include "settings.h"
-
-// Globals
-bool HIDDEN;
-uint32_t FPS;
-uint32_t WIDTH;
-uint32_t HEIGHT;
-uint32_t TILE_SIZE;
-uint32_t HALF_TILE;
-uint32_t DAY_LENGTH;
-uint32_t CYCLES_PER_FRAME;
 
 SDL_Color UI_COLOR = { 255, 127, 80 };
 
-Game::Game(const nlohmann::json& config)
-    : mRun(true)
-    , mResult(false)
-    , mConfig(config)
-    , mTicks(0)
-    , mTotalTicks(0)
+// Characters of the HUD, which only shows the remaining time
+static const char* HUD_GLYPHS = "0123456789.-";
+
+// Circle outlines for bodies and path waypoints side by side, each in a
+// square twice its radius with the centre in the middle
+static const int BODY_RADIUS = 8;
+static const int WAYPOINT_RADIUS = 3;
+static const int SPRITES_WIDTH = 2 * BODY_RADIUS + 2 * WAYPOINT_RADIUS;
+static const int SPRITES_HEIGHT = 2 * BODY_RADIUS;
+
+static void StampCircle(SDL_Surface* surface, int32_t centreX, int32_t centreY, int32_t radius)
+{
+  auto plot = [surface](int32_t x, int32_t y)
+  {
+    // White and opaque in any byte order
+    static_cast<Uint32*>(surface->pixels)[y * surface->pitch / 4 + x] = 0xFFFFFFFF;
+  };
+
+  const int32_t diameter = (radius * 2);
+
+  int32_t x = (radius - 1);
+  int32_t y = 0;
+  int32_t tx = 1;
+  int32_t ty = 1;
+  int32_t error = (tx - diameter);
+
+  while (x >= y)
+  {
+    //  Each of the following renders an octant of the circle
+    plot(centreX + x, centreY - y);
+    plot(centreX + x, centreY + y);
+    plot(centreX - x, centreY - y);
+    plot(centreX - x, centreY + y);
+    plot(centreX + y, centreY - x);
+    plot(centreX + y, centreY + x);
+    plot(centreX - y, centreY - x);
+    plot(centreX - y, centreY + x);
+
+    if (error <= 0)
+    {
+      ++y;
+      error += ty;
+      ty += 2;
+    }
+
+    if (error > 0)
+    {
+      --x;
+      tx += 2;
+      error += (tx - diameter);
+    }
+  }
+}
+
+Game::Game(Simulation& simulation)
+    : Game(simulation.GetSettings(), simulation.GetLevel().Walls())
+{
+  mSimulation = &simulation;
+}
+
+Game::Game(const Settings& settings, const std::vector<Line>& walls)
+    : mSimulation(nullptr)
+    , mSettings(settings)
+    , mWalls(walls)
+    , mQuit(false)
+    , mDone(false)
+    , mFrameTime(0)
+    , mWindow(nullptr)
+    , mRenderer(nullptr)
+    , mFont(nullptr)
+    , mSprites(nullptr)
+    , mBodySprite{ 0, 0, 2 * BODY_RADIUS, 2 * BODY_RADIUS }
+    , mWaypointSprite{ 2 * BODY_RADIUS, 0, 2 * WAYPOINT_RADIUS, 2 * WAYPOINT_RADIUS }
+    , mWallLayer(nullptr)
 {
 }
 
 Game::~Game()
 {
+  if (mSimulation)
+    mSimulation->mFrame = nullptr;
+
+  for (auto& glyph : mGlyphs)
+  {
+    if (glyph.texture)
+      SDL_DestroyTexture(glyph.texture);
+  }
+
+  if (mSprites)
+    SDL_DestroyTexture(mSprites);
+
+  if (mWallLayer)
+    SDL_DestroyTexture(mWallLayer);
+
+  if (mFont)
+    TTF_CloseFont(mFont);
+
+  if (mRenderer)
+    SDL_DestroyRenderer(mRenderer);
+
+  if (mWindow)
+    SDL_DestroyWindow(mWindow);
+
   TTF_Quit();
   SDL_Quit();
 }
 
-bool Game::Init(Args overrides)
+bool Game::Init()
 {
   if (mWindow)
   {
@@ -45,149 +127,269 @@ bool Game::Init(Args overrides)
   SDL_Init(SDL_INIT_VIDEO);
   TTF_Init();
 
-  // Initialise globals
-  RETURN_ON_FAILURE(SetupGlobals(overrides));
+  const Settings& settings = mSettings;
 
-  // Initialise SDL
-  RETURN_ON_FAILURE(SetupSDL());
+  SDL_DisplayMode DM;
+  SDL_GetCurrentDisplayMode(0, &DM);
 
-  return Reset();
-}
+  const int width = settings.width;
+  const int height = settings.height;
+  mWindow = SDL_CreateWindow("Intrusion game", (DM.w - width) / 2, (DM.h - height) / 2, width, height, SDL_WINDOW_SHOWN);
+  LOG_AND_RETURN_ON_FAILURE(mWindow, "Failed to create window");
 
-bool Game::SetupGlobals(Args overrides)
-{
-  FPS              = overrides.fps > 0 ? overrides.fps : uint32_t(mConfig["fps"]);
-  CYCLES_PER_FRAME = overrides.cycles > 0 ? overrides.cycles : uint32_t(mConfig["cycles_per_frame"]);
-  DAY_LENGTH       = uint32_t(mConfig["day_duration"]);
+  SDL_Surface* icon = IMG_Load("../assets/icon.png");
+  SDL_SetWindowIcon(mWindow, icon);
 
-  TILE_SIZE        = uint32_t(mConfig["tile_size"]);
-  HALF_TILE        = TILE_SIZE / 2;
+  // Presenting waits for the display, so frames follow its refresh rate
+  mRenderer = SDL_CreateRenderer(mWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
+  LOG_AND_RETURN_ON_FAILURE(mRenderer, "Failed to create window");
+
+  mFont = TTF_OpenFont("../assets/JetBrainsMonoNL-SemiBold.ttf", 18);
+  LOG_AND_RETURN_ON_FAILURE(mFont, "Could not open font file");
 
-  WIDTH = float(mConfig["width"]) * TILE_SIZE;
-  HEIGHT = float(mConfig["height"]) * TILE_SIZE;
+  // Without vsync frames are paced by the refresh rate, or the config fps
+  // if the display does not report one
+  mFrameTime = 1000 / (DM.refresh_rate > 0 ? DM.refresh_rate : settings.fps);
 
-  HIDDEN = overrides.hidden;
+  RETURN_ON_FAILURE(CreateSprites());
+  RETURN_ON_FAILURE(CreateWallLayer());
+  RETURN_ON_FAILURE(CreateGlyphs());
 
-  mTotalTicks = DAY_LENGTH * 60 * 60;
+  if (mSimulation)
+    mSimulation->mFrame = [this]{ return Publish(); };
 
   return true;
 }
 
-bool Game::SetupSDL()
+bool Game::CreateSprites()
 {
-  SDL_DisplayMode DM;
-  SDL_GetCurrentDisplayMode(0, &DM);
+  SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, SPRITES_WIDTH, SPRITES_HEIGHT, 32, SDL_PIXELFORMAT_RGBA32);
+  LOG_AND_RETURN_ON_FAILURE(surface, "Failed to create sprites");
 
-  uint32_t flags = HIDDEN ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN;
-  mWindow = SDL_CreateWindow("Intrusion game", (DM.w - WIDTH) / 2, (DM.h - HEIGHT) / 2, WIDTH, HEIGHT, flags);
-  LOG_AND_RETURN_ON_FAILURE(mWindow, "Failed to create window");
+  // New surfaces are transparent
+  StampCircle(surface, mBodySprite.x + BODY_RADIUS, mBodySprite.y + BODY_RADIUS, BODY_RADIUS);
+  StampCircle(surface, mWaypointSprite.x + WAYPOINT_RADIUS, mWaypointSprite.y + WAYPOINT_RADIUS, WAYPOINT_RADIUS);
 
-  SDL_Surface* icon = IMG_Load("../assets/icon.png");
-  SDL_SetWindowIcon(mWindow, icon);
+  mSprites = SDL_CreateTextureFromSurface(mRenderer, surface);
+  SDL_FreeSurface(surface);
+  LOG_AND_RETURN_ON_FAILURE(mSprites, "Failed to create sprites");
 
-  mRenderer = SDL_CreateRenderer(mWindow, -1, SDL_RENDERER_ACCELERATED);
-  LOG_AND_RETURN_ON_FAILURE(mRenderer, "Failed to create window");
+  SDL_SetTextureBlendMode(mSprites, SDL_BLENDMODE_BLEND);
+  return true;
+}
 
-  mFont = TTF_OpenFont("../assets/JetBrainsMonoNL-SemiBold.ttf", 18);
-  LOG_AND_RETURN_ON_FAILURE(mFont, "Could not open font file");
+bool Game::CreateWallLayer()
+{
+  const Settings& settings = mSettings;
+  mWallLayer = SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, settings.width, settings.height);
+  LOG_AND_RETURN_ON_FAILURE(mWallLayer, "Failed to create wall layer");
 
-  // Rectagle used to display UI
-  mTextRect.x = 10;
-  mTextRect.y = 10;
+  SDL_SetTextureBlendMode(mWallLayer, SDL_BLENDMODE_BLEND);
+  SDL_SetRenderTarget(mRenderer, mWallLayer);
+  SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 0);
+  SDL_RenderClear(mRenderer);
 
+  SDL_SetRenderDrawColor(mRenderer, 255, 255, 255, 255);
+  for (const auto& wall : mWalls)
+  {
+    // Uncomment to see the dead zones
+    // SDL_Rect deadzone = { wall.deadzone.x, wall.deadzone.y, wall.deadzone.w, wall.deadzone.h };
+    // SDL_RenderFillRect(mRenderer, &deadzone);
+    SDL_RenderDrawLine(mRenderer, wall.p1.x, wall.p1.y, wall.p2.x, wall.p2.y);
+  }
+
+  SDL_SetRenderTarget(mRenderer, NULL);
   return true;
 }
 
-bool Game::Reset()
+bool Game::CreateGlyphs()
 {
-  mRun = true;
-  mResult = false;
-  mTicks = 0;
-
-  // (Re)Create level
-  mLevel = std::make_unique<Level>(mRenderer);
-  mLevel->mReachedDoor = [this]{ Finished(true); };
-  mLevel->mWasCaught = [this]{ Finished(false); };
+  for (const char* c = HUD_GLYPHS; *c; ++c)
+  {
+    SDL_Surface* surface = TTF_RenderGlyph_Solid(mFont, *c, UI_COLOR);
+    LOG_AND_RETURN_ON_FAILURE(surface, "Failed to render HUD glyphs");
+
+    Glyph& glyph = mGlyphs[int(*c)];
+    glyph.w = surface->w;
+    glyph.h = surface->h;
+    glyph.texture = SDL_CreateTextureFromSurface(mRenderer, surface);
+    SDL_FreeSurface(surface);
+    LOG_AND_RETURN_ON_FAILURE(glyph.texture, "Failed to render HUD glyphs");
+  }
 
-  return mLevel->Init(mConfig);
+  return true;
 }
 
-bool Game::Run()
+bool Game::Run(const std::function<bool()>& simulate)
 {
-  while (!IsDone())
+  mDone = false;
+
+  bool result = false;
+  std::thread simulation([&]
   {
-    SDL_Event event;
-    while(SDL_PollEvent(&event) != 0) {
-      if (event.type == SDL_QUIT ||
-          (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE))
-      {
-        Finished(false);
-        return false;  // Return false to prevent future runs
-      }
-    }
+    result = simulate();
+    mDone = true;
+  });
 
-    if (!HIDDEN)
-    {
-      SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 255);
-      SDL_RenderClear(mRenderer);
-    }
+  // SDL has to stay on the thread which created the window
+  while (!mDone)
+  {
+    if (!Frame())
+      mQuit = true;
+  }
 
-    for (uint32_t i = 0; !IsDone() && i < CYCLES_PER_FRAME; ++i)
-    {
-      if (IsDayDone())
-      {
-        Finished(true);
-        break;
-      }
-
-      mLevel->Run();
-      ++mTicks;
-    }
+  simulation.join();
+  return result && !mQuit;
+}
 
-    if (HIDDEN)
-      continue;
+bool Game::Publish()
+{
+  Snapshot& snapshot = mSnapshots.Back();
+  snapshot.Capture(mSimulation->GetLevel(), mSimulation->Ticks(), mSimulation->TotalTicks());
+  mSnapshots.Publish();
 
-    RenderUI();
+  return !mQuit;
+}
 
-    SDL_RenderPresent(mRenderer);
-    SDL_Delay(1000 / FPS);
-  }
+bool Game::Show(const Snapshot& snapshot)
+{
+  // Copying reuses the vectors of the slot, which stop growing after a while
+  mSnapshots.Back() = snapshot;
+  mSnapshots.Publish();
 
-  return true;
+  return !mQuit;
 }
 
-void Game::RenderUI()
+bool Game::Frame()
 {
-  // Render texture
-  SDL_RenderCopy(mRenderer, mTexture, NULL, NULL);
+  Uint32 start = SDL_GetTicks();
+
+  SDL_Event event;
+  while(SDL_PollEvent(&event) != 0) {
+    if (event.type == SDL_QUIT ||
+        (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE))
+      return false;
+
+    if (event.type == SDL_KEYDOWN && mKeyPressed)
+      mKeyPressed(event.key.keysym.sym);
+  }
+
+  mSnapshots.Update();
+  const Snapshot& snapshot = mSnapshots.Front();
+
+  SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 255);
+  SDL_RenderClear(mRenderer);
 
-  std::string text = std::to_string(float(mTotalTicks - mTicks) / 60);
-  SDL_Surface* text_surf = TTF_RenderText_Solid(mFont, text.c_str(), UI_COLOR);
-  mText = SDL_CreateTextureFromSurface(mRenderer, text_surf);
+  DrawSnapshot(snapshot);
 
-  mTextRect.w = text_surf->w;
-  mTextRect.h = text_surf->h;
-  SDL_RenderCopy(mRenderer, mText, NULL, &mTextRect);
-  SDL_FreeSurface(text_surf);
+  RenderUI(snapshot);
+
+  SDL_RenderPresent(mRenderer);
+
+  Uint32 elapsed = SDL_GetTicks() - start;
+  if (elapsed < mFrameTime)
+    SDL_Delay(mFrameTime - elapsed);
+
+  return true;
 }
 
-void Game::Finished(bool result)
+void Game::DrawSnapshot(const Snapshot& snapshot)
 {
-  mRun = false;
-  mResult = result;
+  mVertices.clear();
+  mIndices.clear();
+
+  for (const auto& body : snapshot.movables)
+    DrawPath(snapshot, body);
+
+  for (const auto& body : snapshot.attackers)
+    DrawPath(snapshot, body);
+
+  mOpenDoors.clear();
+  mClosedDoors.clear();
+  for (const auto& door : snapshot.doors)
+  {
+    SDL_Rect rect = { door.area.x, door.area.y, door.area.w, door.area.h };
+    if (door.open)
+      mOpenDoors.push_back(rect);
+    else
+      mClosedDoors.push_back(rect);
+  }
+
+  SDL_SetRenderDrawColor(mRenderer, 0, 255, 0, 255);
+  SDL_RenderDrawRects(mRenderer, mOpenDoors.data(), mOpenDoors.size());
+  SDL_SetRenderDrawColor(mRenderer, 255, 0, 0, 255);
+  SDL_RenderDrawRects(mRenderer, mClosedDoors.data(), mClosedDoors.size());
+
+  for (const auto& body : snapshot.movables)
+    AddSprite(mBodySprite, body.x, body.y, body.checking ? Color{255, 127, 80} : body.color);
+
+  for (const auto& body : snapshot.attackers)
+    AddSprite(mBodySprite, body.x, body.y, body.checking ? Color{255, 127, 80} : body.color);
+
+  // All circles of the frame in one call
+  if (!mIndices.empty())
+    SDL_RenderGeometry(mRenderer, mSprites, mVertices.data(), mVertices.size(), mIndices.data(), mIndices.size());
+
+  SDL_RenderCopy(mRenderer, mWallLayer, NULL, NULL);
 }
 
-Result Game::GetResult()
+void Game::DrawPath(const Snapshot& snapshot, const Snapshot::Body& body)
 {
-  return Result{mResult, float(mTicks) / 60, mLevel->GetResult()};
+  if (body.pathEnd - body.pathBegin < 2)
+    return;
+
+  // Path still to be walked as one polyline, its waypoints join the sprites
+  mPoints.clear();
+  for (uint32_t i = body.pathBegin; i < body.pathEnd; ++i)
+  {
+    auto p = snapshot.paths[i];
+    mPoints.push_back(SDL_Point{ int(p.x), int(p.y) });
+
+    if (i + 1 < body.pathEnd)
+      AddSprite(mWaypointSprite, int(p.x), int(p.y), body.color);
+  }
+
+  SDL_SetRenderDrawColor(mRenderer, body.color.r, body.color.g, body.color.b, 255);
+  SDL_RenderDrawLines(mRenderer, mPoints.data(), mPoints.size());
 }
 
-bool Game::IsDone() const
+void Game::AddSprite(const SDL_Rect& sprite, float x, float y, Color color)
 {
-  return !mRun;
+  // Pixel centres like the points the circles used to be drawn with
+  const float left = int(x) - sprite.w / 2;
+  const float top = int(y) - sprite.h / 2;
+  const float u0 = float(sprite.x) / SPRITES_WIDTH;
+  const float v0 = float(sprite.y) / SPRITES_HEIGHT;
+  const float u1 = float(sprite.x + sprite.w) / SPRITES_WIDTH;
+  const float v1 = float(sprite.y + sprite.h) / SPRITES_HEIGHT;
+  const SDL_Color tint = { color.r, color.g, color.b, 255 };
+
+  const int first = mVertices.size();
+  mVertices.push_back(SDL_Vertex{ { left, top }, tint, { u0, v0 } });
+  mVertices.push_back(SDL_Vertex{ { left + sprite.w, top }, tint, { u1, v0 } });
+  mVertices.push_back(SDL_Vertex{ { left, top + sprite.h }, tint, { u0, v1 } });
+  mVertices.push_back(SDL_Vertex{ { left + sprite.w, top + sprite.h }, tint, { u1, v1 } });
+
+  for (int i : { 0, 1, 2, 2, 1, 3 })
+    mIndices.push_back(first + i);
 }
 
-bool Game::IsDayDone() const
+void Game::RenderUI(const Snapshot& snapshot)
 {
-  return mTicks >= mTotalTicks;
-}
\ No newline at end of file
+  // Same text as std::to_string, without allocating it
+  char text[32];
+  snprintf(text, sizeof(text), "%f", float(snapshot.totalTicks - snapshot.ticks) / 60);
+
+  SDL_Rect rect = { 10, 10, 0, 0 };
+  for (const char* c = text; *c; ++c)
+  {
+    const Glyph& glyph = mGlyphs[*c & 127];
+    if (!glyph.texture)
+      continue;
+
+    rect.w = glyph.w;
+    rect.h = glyph.h;
+    SDL_RenderCopy(mRenderer, glyph.texture, NULL, &rect);
+    rect.x += glyph.w;
+  }
+}
@@ -1,49 +1,96 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <string>
-#include <memory>
+#include <vector>
 
-#include <nlohmann/json.hpp>
 #include <SDL2/SDL.h>
 #include "SDL2/SDL_ttf.h"
 
-#include "level.h"
+#include "simulation.h"
+#include "snapshot.h"
 
+// SDL window showing a simulation while it runs. The simulation runs on a
+// thread of its own at full speed and publishes a snapshot of the level
+// every cyclesPerFrame ticks, while this thread draws the latest snapshot
+// at the refresh rate of the display. The simulation never touches SDL and
+// never waits for drawing.
+//
+// Drawing is batched: every circle of a frame is a quad of one sprite atlas,
+// tinted per vertex and submitted with a single SDL_RenderGeometry call, the
+// walls are drawn once into a layer of their own and the HUD is put together
+// from glyphs rendered at Init.
 class Game
 {
 public:
-  Game(const nlohmann::json& config);
+  Game(Simulation& simulation);
+
+  // Without a simulation, whatever runs in Run hands its frames to Show
+  Game(const Settings& settings, const std::vector<Line>& walls);
   ~Game();
 
-  bool Init(Args overrides);
-  bool Run();
+  bool Init();
+
+  // Call simulate on the simulation thread and show it until it returns,
+  // false if the window was closed or simulate failed
+  bool Run(const std::function<bool()>& simulate);
 
-  bool Reset();
+  // Show snapshot from the simulation thread, false once the window is closed
+  bool Show(const Snapshot& snapshot);
 
-  Result GetResult();
+  // Called on this thread for every key other than escape
+  std::function<void(int32_t key)> mKeyPressed;
 
 private:
-  bool mRun;
-  bool mResult;
+  Simulation* mSimulation;
+  Settings mSettings;
+
+  SnapshotBuffer mSnapshots;
+  std::vector<Line> mWalls;  // Never change, so they are not part of the snapshots
+  std::atomic<bool> mQuit;
+  std::atomic<bool> mDone;
+  uint32_t mFrameTime;  // Milliseconds per frame
 
   SDL_Window *mWindow;
   SDL_Renderer *mRenderer;
-  SDL_Texture *mTexture, *mText;
   TTF_Font  *mFont;
-  SDL_Rect mTextRect;
 
-  nlohmann::json mConfig;
+  // White circle outlines, tinted with the colour of the vertices
+  SDL_Texture *mSprites;
+  SDL_Rect mBodySprite;
+  SDL_Rect mWaypointSprite;
+
+  SDL_Texture *mWallLayer;
+
+  // HUD characters, null for the ones which are never shown
+  struct Glyph
+  {
+    SDL_Texture* texture = nullptr;
+    int w = 0;
+    int h = 0;
+  };
+  Glyph mGlyphs[128];
+
+  // Geometry of the current frame, kept so drawing does not allocate
+  std::vector<SDL_Vertex> mVertices;
+  std::vector<int> mIndices;
+  std::vector<SDL_Point> mPoints;
+  std::vector<SDL_Rect> mOpenDoors;
+  std::vector<SDL_Rect> mClosedDoors;
 
-  std::unique_ptr<Level> mLevel;
+  bool CreateSprites();
+  bool CreateWallLayer();
+  bool CreateGlyphs();
 
-  uint32_t mTicks;
-  uint32_t mTotalTicks;
+  // Called by the simulation between ticks, false once the window is closed
+  bool Publish();
 
-  bool SetupSDL();
-  bool SetupGlobals(Args overrides);
+  // Show the latest snapshot, false once the window is closed
+  bool Frame();
 
-  void Finished(bool result);
-  bool IsDayDone() const;
-  bool IsDone() const;
-  void RenderUI();
-};
\ No newline at end of file
+  void DrawSnapshot(const Snapshot& snapshot);
+  void DrawPath(const Snapshot& snapshot, const Snapshot::Body& body);
+  void AddSprite(const SDL_Rect& sprite, float x, float y, Color color);
+  void RenderUI(const Snapshot& snapshot);
+};
@@ -3,88 +3,200 @@
 #include "stdio.h"
 #include "helpers.h"
 
-Guard::Guard(uint32_t id, const nlohmann::json& config,
+Guard::Guard(uint32_t id, const GuardConfig& config,
              const std::vector<PMovable>& movables,
-             const std::vector<Line>& walls,
-             SDL_Renderer* renderer)
-    : Movable(0, 0, walls, renderer)
+             const NavGrid& nav,
+             const Settings& settings)
+    : Movable(0, 0, nav, settings)
     , mId(id)
     , mMovables(movables)
     , mCheckTime(0)
     , mMissionTime(0)
     , mInMission(false)
+    , mHasCandidates(false)
+    , mWalking(false)
+    , mBehaviour(config.behaviour)
 {
-  // For rand() later
-  srand (time(NULL));
-
-  mPos = GetRandomPoint();
-
   SetColor(255, 0, 0);
 
-  mCheckSpeed = float(config["check_speed"]) * TILE_SIZE;
-  mStrollSpeed = float(config["stroll_speed"]) * TILE_SIZE;
+  mCheckSpeed = config.checkSpeed * settings.tileSize;
+  mStrollSpeed = config.strollSpeed * settings.tileSize;
   mSpeed = mStrollSpeed;
 
-  auto behaviour = config["behaviour"];
-  if (behaviour == "stroll")
-    mBehaviour = Behaviour::STROLL;
-  else if (behaviour == "reset")
-    mBehaviour = Behaviour::RESET;
-  else
-    throw std::runtime_error("Guard behaviour is invalid");
-
-  mShowRadius = float(config["check_radius"]) * TILE_SIZE;
+  mShowRadius = config.checkRadius * settings.tileSize;
   mCheckRadius = std::pow(mShowRadius, 2.0);
 
-  float maxCheckTime = float(config["max_check_time"]) * 60;
-  float minCheckTime = float(config["min_check_time"]) * 60;
-  mRandomCheck = std::make_unique<Randomizer>(minCheckTime, maxCheckTime);
+  mRandomCheck = std::make_unique<Randomizer>(config.minCheckTime, config.maxCheckTime);
 
-  uint32_t dayInTicks = DAY_LENGTH * 60 * 60;
-  mInterMissionPeriod = dayInTicks / float(config["number_of_missions"]);
+  uint32_t dayInTicks = settings.dayLength * 60 * 60;
+  mInterMissionPeriod = dayInTicks / config.numberOfMissions;
 
-  float maxMissionTime = float(config["max_mission_time"]) * 60;
-  float minMissionTime = float(config["min_mission_time"]) * 60;
-  mRandomMission = std::make_unique<Randomizer>(minMissionTime, maxMissionTime);
+  mRandomMission = std::make_unique<Randomizer>(config.minMissionTime, config.maxMissionTime);
+  mRandomIntermission = std::make_unique<Randomizer>(0, mInterMissionPeriod / 2);
 
-  Randomizer intermission(0, mInterMissionPeriod / 2);
-  mWaitForMissionTime = intermission.Uniform();
+  // Only Index is used, which ignores the range
+  mRandomReplica = std::make_unique<Randomizer>(0, 1);
 
-  mMovablesPerCheck = uint32_t(config["entities_per_check"]);
+  mMovablesPerCheck = config.entitiesPerCheck;
 
-  mInitialPos.x = mPos.x;
-  mInitialPos.y = mPos.y;
+  // Checks only pick from the movables, so ticks never grow these
+  mBeingChecked.reserve(mMovables.size());
+  mCandidates.reserve(mMovables.size());
+  mPossibleChecks.reserve(mMovables.size());
 }
 
 Guard::~Guard()
 {
 }
 
+void Guard::Reset()
+{
+  Movable::Reset();
+
+  mPos = GetRandomPoint();
+  mInitialPos = mPos;
+
+  mCheckTime = 0;
+  mMissionTime = 0;
+  mInMission = false;
+  mSpeed = mStrollSpeed;
+  mBeingChecked.clear();
+  mCandidates.clear();
+  mReplicaCandidates.clear();
+  mHasCandidates = false;
+  mWalking = false;
+
+  mWaitForMissionTime = mRandomIntermission->Uniform();
+}
+
+void Guard::Save(Snapshot& snapshot) const
+{
+  Movable::Save(snapshot.movable);
+  snapshot.initialPos = mInitialPos;
+
+  snapshot.beingChecked.clear();
+  for (const auto& e : mBeingChecked)
+  {
+    auto it = std::find(mMovables.begin(), mMovables.end(), e);
+    snapshot.beingChecked.push_back(it - mMovables.begin());
+  }
+
+  snapshot.inMission = mInMission;
+  snapshot.missionTime = mMissionTime;
+  snapshot.waitForMissionTime = mWaitForMissionTime;
+  snapshot.checkTime = mCheckTime;
+
+  snapshot.randomCheck = mRandomCheck->Save();
+  snapshot.randomMission = mRandomMission->Save();
+  snapshot.randomIntermission = mRandomIntermission->Save();
+  snapshot.randomReplica = mRandomReplica->Save();
+}
+
+void Guard::Restore(const Snapshot& snapshot)
+{
+  Movable::Restore(snapshot.movable);
+  mInitialPos = snapshot.initialPos;
+
+  mBeingChecked.clear();
+  for (auto i : snapshot.beingChecked)
+    mBeingChecked.push_back(mMovables.at(i));
+
+  mInMission = snapshot.inMission;
+  mMissionTime = snapshot.missionTime;
+  mWaitForMissionTime = snapshot.waitForMissionTime;
+  mCheckTime = snapshot.checkTime;
+
+  // Snapshots are only taken between ticks, when nothing is cached
+  mCandidates.clear();
+  mReplicaCandidates.clear();
+  mHasCandidates = false;
+  mWalking = false;
+
+  mRandomCheck->Restore(snapshot.randomCheck);
+  mRandomMission->Restore(snapshot.randomMission);
+  mRandomIntermission->Restore(snapshot.randomIntermission);
+  mRandomReplica->Restore(snapshot.randomReplica);
+}
+
+void Guard::Reseed(uint64_t key, bool mirrored)
+{
+  Movable::Reseed(key, mirrored);
+  mRandomCheck->Seed(Randomizer::Key(key, 3), mirrored);
+  mRandomMission->Seed(Randomizer::Key(key, 4), mirrored);
+  mRandomIntermission->Seed(Randomizer::Key(key, 5), mirrored);
+  mRandomReplica->Seed(Randomizer::Key(key, 6), mirrored);
+}
+
+void Guard::SetReplicas(const std::vector<PMovable>& replicas)
+{
+  mReplicas = replicas;
+  mReplicaCandidates.reserve(mReplicas.size());
+}
+
 float Guard::CheckRadius() const
 {
   return mCheckRadius;
 }
 
-void Guard::Update()
+void Guard::FindCandidates()
 {
-  Movable::Update();
+  mCandidates.clear();
+  mReplicaCandidates.clear();
+  mHasCandidates = true;
 
-  if (HIDDEN)
+  // Guards which cannot start a check this tick have nothing to look for
+  if (!mInMission && mWaitForMissionTime > 0)
     return;
 
-  // Uncomment to see radius of detection
-  // if (!mInMission)
-  //   SDL_SetRenderDrawColor(mRenderer, 255, 255, 255, 255);
-  // DrawCircle(mPos.x, mPos.y, mShowRadius);
+  FindCandidates(mMovables, mCandidates);
+  FindCandidates(mReplicas, mReplicaCandidates);
+}
+
+void Guard::FindCandidates(const std::vector<PMovable>& movables, std::vector<PMovable>& candidates) const
+{
+  for (auto& e : movables)
+  {
+    if (!e->IsPresent())
+      continue;
+
+    // Guards only check entities within a certain radius
+    if (Distance(mPos.x, mPos.y, e->X(), e->Y()) >= mCheckRadius)
+      continue;
+
+    // Make sure we are not checking someone through a wall
+    if (mNav.IsVisible(mPos, e->Pos()))
+      candidates.push_back(e);
+  }
+}
+
+void Guard::Resolve()
+{
+  mGoal = GetRandomPoint();
+  mWalking = Decide();
+  mHasCandidates = false;
+}
+
+void Guard::Walk()
+{
+  if (mWalking)
+    Advance(mGoal);
+
+  mWalking = false;
 }
 
 void Guard::Move(const Point& goal)
+{
+  if (Decide())
+    Advance(goal);
+}
+
+bool Guard::Decide()
 {
   if (mWaitForMissionTime > 0)
   {
-    --mWaitForMissionTime;
+    CountDown(mWaitForMissionTime, mSettings.timeStep);
     if (mBehaviour == Behaviour::RESET)
-      return;
+      return false;
   }
   else
   {
@@ -92,14 +204,14 @@ void Guard::Move(const Point& goal)
   }
 
   if (mMissionTime > 0)
-    --mMissionTime;
+    CountDown(mMissionTime, mSettings.timeStep);
   else
     StopMission();
 
   if (mCheckTime > 0)
   {
-    --mCheckTime;
-    return;
+    CountDown(mCheckTime, mSettings.timeStep);
+    return false;
   }
 
   if (IsChecking())
@@ -112,6 +224,11 @@ void Guard::Move(const Point& goal)
   if (mInMission)
     PerformCheck();
 
+  return true;
+}
+
+void Guard::Advance(const Point& goal)
+{
   mState = State::ACTIVE;
   Movable::Move(goal);
 
@@ -156,29 +273,37 @@ void Guard::PerformCheck()
   if (!mBeingChecked.empty())
     return;
 
-  std::vector<PMovable> possibleChecks;
-  for (auto& e : mMovables)
-  {
-    if (e->IsChecking())
-      continue;
-
-    // Guards only check entities within a certain radius
-    if (Distance(mPos.x, mPos.y, e->X(), e->Y()) >= mCheckRadius)
-      continue;
+  if (!mHasCandidates)
+    FindCandidates();
+  mHasCandidates = false;
 
-    // Make sure we are not checking someone through a wall
-    Point min = Raycast(mPos, e->Pos(), mWalls);
-    if (min == e->Pos())
+  // Entities already taken by another guard are no longer available
+  auto& possibleChecks = mPossibleChecks;
+  possibleChecks.clear();
+  for (auto& e : mCandidates)
+  {
+    if (!e->IsChecking())
       possibleChecks.push_back(e);
   }
 
+  // Replicas never take part in the check itself. Each one is caught with the
+  // chance it would have had as the only attacker among the possible checks.
+  // Their draws come from a sequence of their own, so the rest of the level
+  // sees the same numbers with any number of replicas
+  uint32_t picks = std::min<uint32_t>(mMovablesPerCheck, possibleChecks.size() + 1);
+  for (auto& replica : mReplicaCandidates)
+  {
+    if (mRandomReplica->Index(possibleChecks.size() + 1) < picks)
+      replica->StartCheck(mId);
+  }
+
   if (possibleChecks.empty())
     return;
 
   // Of the possible checks, only a few are actually selected
   for (uint32_t i = 0; i < mMovablesPerCheck && !possibleChecks.empty(); ++i)
   {
-    int index = rand() % possibleChecks.size();
+    int index = mRandom->Index(possibleChecks.size());
     mBeingChecked.push_back(possibleChecks.at(index));
     possibleChecks.erase(possibleChecks.begin() + index);
   }
@@ -207,9 +332,8 @@ void Guard::RayCast(std::vector<PMovable>& checks)
   for (auto iter = checks.begin(); iter < checks.end();)
   {
     Point p((*iter)->X(), (*iter)->Y());
-    Point min = Raycast(mPos, p, mWalls);
 
-    if (min == p)
+    if (mNav.IsVisible(mPos, p))
       iter++;
     else
       iter = checks.erase(iter);
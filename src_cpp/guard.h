@@ -3,8 +3,7 @@
 #include <memory>
 #include <vector>
 
-#include <nlohmann/json.hpp>
-
+#include "blueprint.h"
 #include "movable.h"
 #include "randomizer.h"
 #include "settings.h"
@@ -12,17 +11,52 @@
 class Guard : public Movable
 {
 public:
-  Guard(uint32_t id, const nlohmann::json& config,
+  Guard(uint32_t id, const GuardConfig& config,
         const std::vector<PMovable>& movables,
-        const std::vector<Line>& lines,
-        SDL_Renderer* renderer);
+        const NavGrid& nav,
+        const Settings& settings);
   ~Guard();
 
-  void Update() override;
+  void Reset() override;
 
   float CheckRadius() const;
 
+  // Attackers which are checked without the guard actually stopping for them
+  void SetReplicas(const std::vector<PMovable>& replicas);
+
+  struct Snapshot
+  {
+    Movable::Snapshot movable;
+    Point initialPos;
+
+    // Indices into the movables given on construction
+    std::vector<uint32_t> beingChecked;
+
+    bool inMission = false;
+    uint32_t missionTime = 0;
+    uint32_t waitForMissionTime = 0;
+    uint32_t checkTime = 0;
+
+    Randomizer::State randomCheck;
+    Randomizer::State randomMission;
+    Randomizer::State randomIntermission;
+    Randomizer::State randomReplica;
+  };
+
+  void Save(Snapshot& snapshot) const;
+  void Restore(const Snapshot& snapshot);
+  void Reseed(uint64_t key, bool mirrored) override;
+
+  // Parallel tick, split in phases so shared entities are only written in Resolve:
+  // FindCandidates may run concurrently for all guards, Resolve must be called
+  // in guard order on one thread and Walk may run concurrently again
+  void FindCandidates();
+  void Resolve();
+  void Walk();
+
 private:
+  using Behaviour = GuardConfig::Behaviour;
+
   uint32_t mId;
   int mCheckSpeed;
   int mStrollSpeed;
@@ -31,9 +65,19 @@ private:
 
   std::vector<PMovable> mMovables;
   std::vector<PMovable> mBeingChecked;
+  std::vector<PMovable> mCandidates;
+  std::vector<PMovable> mPossibleChecks;  // Only kept to reuse its memory
+  std::vector<PMovable> mReplicas;
+  std::vector<PMovable> mReplicaCandidates;
+  bool mHasCandidates;
+
+  Point mGoal;
+  bool mWalking;
 
   std::unique_ptr<Randomizer> mRandomCheck;
   std::unique_ptr<Randomizer> mRandomMission;
+  std::unique_ptr<Randomizer> mRandomIntermission;
+  std::unique_ptr<Randomizer> mRandomReplica;  // Catches of attacker replicas
 
   bool mInMission;
   uint32_t mMissionTime;
@@ -45,18 +89,18 @@ private:
   uint32_t mCheckTime;
   uint32_t mMovablesPerCheck;
 
-  enum class Behaviour
-  {
-    STROLL,
-    RESET
-  } mBehaviour;
+  Behaviour mBehaviour;
 
   void Move(const Point& goal) override;
 
+  bool Decide();
+  void Advance(const Point& goal);
+
   void StartMission();
   void StopMission();
 
   void PerformCheck();
+  void FindCandidates(const std::vector<PMovable>& movables, std::vector<PMovable>& candidates) const;
   void ResetPosition();
 
   void RayCast(std::vector<PMovable>& checks);
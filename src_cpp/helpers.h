@@ -3,29 +3,29 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include <SDL2/SDL.h>
-
 #include <algorithm>
 #include <cmath>
 #include <ctime>
 #include <iomanip>
+#include <memory_resource>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "arena.h"
 #include "guard.h"
 
 #define RETURN_ON_FAILURE(c)             \
   do                                     \
   {                                      \
-    if (!c)                              \
+    if (!(c))                            \
       return false;                      \
   } while (0)
 
 #define LOG_AND_RETURN_ON_FAILURE(c,  m) \
   do                                     \
   {                                      \
-    if (!c)                              \
+    if (!(c))                            \
     {                                    \
       printf("%s\n", m);                 \
       return false;                      \
@@ -72,6 +72,12 @@ static std::string GetDate()
   return oss.str();
 }
 
+// Count a timer down by one update, stopping at zero when the step overshoots
+static void CountDown(uint32_t& timer, uint32_t step)
+{
+  timer -= std::min(timer, step);
+}
+
 static float Distance(float x1, float y1, float x2, float y2)
 {
   return std::pow(x2 - x1, 2) + std::pow(y2 - y1, 2);
@@ -118,27 +124,32 @@ static Point Raycast(const Point& p3, const Point& p4, const std::vector<Line>&
   return minPoint;
 }
 
-static Point ToWorld(const Point& p)
+static Point ToWorld(const Point& p, uint32_t tileSize)
 {
-  return Point(floor(p.x / TILE_SIZE), floor(p.y / TILE_SIZE));
+  return Point(floor(p.x / tileSize), floor(p.y / tileSize));
 }
 
-static Point FromWorld(const Point& p)
+static Point FromWorld(const Point& p, uint32_t tileSize)
 {
-  return Point(p.x * TILE_SIZE + HALF_TILE - 1, p.y * TILE_SIZE + HALF_TILE - 1);
+  return Point(p.x * tileSize + tileSize / 2 - 1, p.y * tileSize + tileSize / 2 - 1);
 }
 
-static std::vector<Point> ToPoints(const std::vector<std::vector<Cost>>& map, const Point& start, const Point& dest)
+typedef std::pmr::vector<std::pmr::vector<Cost>> CostMap;
+
+// Longer paths are cut off, so paths of entities never need more room
+static const int MAX_PATH_POINTS = 100;
+
+static void ToPoints(const CostMap& map, const Point& start, const Point& dest, uint32_t tileSize, std::vector<Point>& points)
 {
-  std::vector<Point> points;
+  points.clear();
 
   int x = dest.x;
   int y = dest.y;
 
   // Go back until we reach the start position
-  for (int k = 0; k < 100; k++)
+  for (int k = 0; k < MAX_PATH_POINTS; k++)
   {
-    points.push_back(FromWorld(Point(x, y)));
+    points.push_back(FromWorld(Point(x, y), tileSize));
     if (x == start.x && y == start.y)
       break;
 
@@ -150,36 +161,42 @@ static std::vector<Point> ToPoints(const std::vector<std::vector<Cost>>& map, co
   }
 
   std::reverse(points.begin(), points.end());
-
-  return points;
 }
 
-static std::vector<Point> PathFinding(const Point& start, const Point& end, const std::vector<Line>& lines, const std::vector<PGuard>& guards)
+// The path is written into points, which keeps its capacity between searches.
+// Everything else only lives during the search and comes from the scratch arena
+static void PathFinding(const Point& start, const Point& end, const NavGrid& nav, const std::vector<PGuard>& guards, std::vector<Point>& points)
 {
+  points.clear();
+
   for (const auto& guard : guards)
   {
     if (Distance(end.x, end.y, guard->X(), guard->Y()) <= guard->CheckRadius())
-      return std::vector<Point>();
+      return;
   }
 
-  Point cp = ToWorld(start);
-  Point cpEnd = ToWorld(end);
+  Arena& arena = ScratchArena();
+  arena.Rewind();
+
+  const uint32_t tileSize = nav.TileSize();
+  Point cp = ToWorld(start, tileSize);
+  Point cpEnd = ToWorld(end, tileSize);
 
   // Vector with nodes we still need to visit and costs were already calculated
-  std::vector<Cost> openList;
+  std::pmr::vector<Cost> openList(&arena);
 
   // Vector with all visited nodes
-  std::vector<Point> closedList;
+  std::pmr::vector<Point> closedList(&arena);
 
-  const int width = WIDTH / TILE_SIZE;
-  const int height = HEIGHT / TILE_SIZE;
+  const int width = nav.Width() / tileSize;
+  const int height = nav.Height() / tileSize;
 
-  std::vector<std::vector<Cost>> map(width + 1, std::vector<Cost>(height + 1));
+  CostMap map(width + 1, std::pmr::vector<Cost>(height + 1, &arena), &arena);
 
   // printf("Finding openList from %.2f %.2f to %.2f %.2f in map %ux%u\n", cp.x, cp.y, cpEnd.x, cpEnd.y, width, height);
 
   if (cpEnd.x < 0 || cpEnd.x >= width || cpEnd.y < 0 || cpEnd.y >= height)
-    return std::vector<Point>();
+    return;
 
   // Create map
   for (int i = 0; i <= width; ++i)
@@ -230,18 +247,18 @@ static std::vector<Point> PathFinding(const Point& start, const Point& end, cons
           continue;
 
         // Check if we are blocked by a wall
-        Point wp = FromWorld(p);
-        Point wpp = FromWorld(pp);
-        Point minPoint = Raycast(wp, wpp, lines);
-        if (minPoint != wpp)
+        if (!nav.CanStep(p.x, p.y, i, j))
           continue;
 
+        Point wpp = FromWorld(pp, tileSize);
+
         if (pp == cpEnd)
         {
           // Only the parent information is needed for the final location
           // printf("FOUND PATH\n");
           map[pp.x][pp.y].parent = p;
-          return ToPoints(map, cp, cpEnd);
+          ToPoints(map, cp, cpEnd, tileSize, points);
+          return;
         }
 
         // Calculate costs
@@ -269,13 +286,12 @@ static std::vector<Point> PathFinding(const Point& start, const Point& end, cons
     }
   }
 
-  // If openList is not found, return empty vector
-  return std::vector<Point>();
+  // If no path is found, points stays empty
   // For debugging, it is easier to see the full explored closedList
-  // return closedList;
+  // points.assign(closedList.begin(), closedList.end());
 }
 
-static std::vector<Point> PathFinding(const Point& start, const Point& end, const std::vector<Line>& lines)
+static void PathFinding(const Point& start, const Point& end, const NavGrid& nav, std::vector<Point>& points)
 {
-  return PathFinding(start, end, lines, std::vector<PGuard>());
+  PathFinding(start, end, nav, std::vector<PGuard>(), points);
 }
\ No newline at end of file
@@ -1,14 +1,15 @@
 #include "level.h"
 
+#include <cfloat>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 
 #include "helpers.h"
 
-using json = nlohmann::json;
-
-Level::Level(SDL_Renderer* renderer)
-    : mRenderer(renderer)
+Level::Level(const Settings& settings)
+    : mSettings(settings)
+    , mPool(nullptr)
 {
 }
 
@@ -16,35 +17,205 @@ Level::~Level()
 {
 }
 
-bool Level::Init(const nlohmann::json& config)
+bool Level::Init(const Blueprint& blueprint, uint32_t replicas)
 {
-  LOG_AND_RETURN_ON_FAILURE(CreateWalls(config["walls"]), "Failed to create walls");
-  LOG_AND_RETURN_ON_FAILURE(CreateDoors(config["doors"], mRenderer), "Failed to create doors");
-  LOG_AND_RETURN_ON_FAILURE(CreateAttacker(config["attacker"], mRenderer), "Failed to create attacker");
-  LOG_AND_RETURN_ON_FAILURE(CreateEmployees(config["employees"], mRenderer), "Failed to create employees");
-  LOG_AND_RETURN_ON_FAILURE(CreateGuards(config["guards"], mRenderer), "Failed to create guards");
+  mWalls = blueprint.walls;
+  mNavigation = blueprint.navigation;
+  LOG_AND_RETURN_ON_FAILURE(mNavigation, "Level has no navigation data");
+
+  LOG_AND_RETURN_ON_FAILURE(CreateDoors(blueprint.doors), "Failed to create doors");
+  LOG_AND_RETURN_ON_FAILURE(CreateAttackers(blueprint.attacker, std::max<uint32_t>(replicas, 1)), "Failed to create attacker");
+  LOG_AND_RETURN_ON_FAILURE(CreateEmployees(blueprint.employees), "Failed to create employees");
+  LOG_AND_RETURN_ON_FAILURE(CreateGuards(blueprint.guards), "Failed to create guards");
 
-  mAttacker->SetGuards(mGuards);
+  for (auto& attacker : mAttackers)
+    attacker->SetGuards(mGuards);
 
   return true;
 }
 
+bool Level::Reset()
+{
+  for (auto& door : mDoors)
+    door->Reset();
+
+  for (auto& attacker : mAttackers)
+    attacker->Reset();
+
+  std::fill(mActive.begin(), mActive.end(), 1);
+
+  for (auto& employee : mEmployees)
+    employee->Reset();
+
+  for (auto& guard : mGuards)
+    guard->Reset();
+
+  return true;
+}
+
+void Level::Save(LevelSnapshot& snapshot) const
+{
+  snapshot.doors.resize(mDoors.size());
+  for (uint32_t i = 0; i < mDoors.size(); ++i)
+    mDoors[i]->Save(snapshot.doors[i]);
+
+  snapshot.attackers.resize(mAttackers.size());
+  for (uint32_t i = 0; i < mAttackers.size(); ++i)
+    mAttackers[i]->Save(snapshot.attackers[i]);
+
+  snapshot.employees.resize(mEmployees.size());
+  for (uint32_t i = 0; i < mEmployees.size(); ++i)
+    mEmployees[i]->Save(snapshot.employees[i]);
+
+  snapshot.guards.resize(mGuards.size());
+  for (uint32_t i = 0; i < mGuards.size(); ++i)
+    mGuards[i]->Save(snapshot.guards[i]);
+}
+
+void Level::Restore(const LevelSnapshot& snapshot)
+{
+  for (uint32_t i = 0; i < mDoors.size(); ++i)
+    mDoors[i]->Restore(snapshot.doors.at(i));
+
+  for (uint32_t i = 0; i < mAttackers.size(); ++i)
+    mAttackers[i]->Restore(snapshot.attackers.at(i));
+
+  for (uint32_t i = 0; i < mEmployees.size(); ++i)
+    mEmployees[i]->Restore(snapshot.employees.at(i));
+
+  for (uint32_t i = 0; i < mGuards.size(); ++i)
+    mGuards[i]->Restore(snapshot.guards.at(i));
+}
+
+// Far above the number of entities of any level
+static const uint64_t FIRST_REPLICA_ENTITY = 1ull << 32;
+
+void Level::Reseed(uint64_t key, bool mirrored)
+{
+  // Entities are numbered in creation order. With common random numbers
+  // they are numbered within their kind instead, so adding employees or
+  // guards leaves the sequences of every other entity as they were
+  uint64_t entity = 0;
+  auto entityKey = [&](uint64_t kind, uint64_t index)
+  {
+    uint64_t number = entity++;
+    if (mSettings.commonRandom)
+      return Randomizer::Key(Randomizer::Key(key, kind), index);
+
+    return Randomizer::Key(key, number);
+  };
+
+  for (uint32_t i = 0; i < mDoors.size(); ++i)
+    mDoors[i]->Reseed(entityKey(0, i), mirrored);
+
+  // Replicas after the first are numbered after every possible entity, so
+  // the number of replicas leaves the sequences of the level as they were
+  for (uint32_t i = 0; i < mAttackers.size(); ++i)
+  {
+    if (i > 0 && !mSettings.commonRandom)
+      mAttackers[i]->Reseed(Randomizer::Key(key, FIRST_REPLICA_ENTITY + i), mirrored);
+    else
+      mAttackers[i]->Reseed(entityKey(1, i), mirrored);
+  }
+
+  for (uint32_t i = 0; i < mEmployees.size(); ++i)
+    mEmployees[i]->Reseed(entityKey(2, i), mirrored);
+
+  for (uint32_t i = 0; i < mGuards.size(); ++i)
+    mGuards[i]->Reseed(entityKey(3, i), mirrored);
+}
+
+void Level::ReseedIteration(uint64_t batchKey, uint32_t iteration)
+{
+  if (!mSettings.antithetic)
+  {
+    Reseed(Randomizer::Key(batchKey, iteration));
+    return;
+  }
+
+  Reseed(Randomizer::Key(batchKey, iteration & ~1u), iteration & 1);
+}
+
+float Level::DistanceToOpenDoor() const
+{
+  float closest = FLT_MAX;
+  for (const auto& door : mDoors)
+  {
+    if (door->IsOpen())
+      closest = std::min(closest, Distance(mAttackers[0]->X(), mAttackers[0]->Y(), door->X(), door->Y()));
+  }
+
+  // Distance is squared and in pixels
+  return closest == FLT_MAX ? closest : std::sqrt(closest) / mSettings.tileSize;
+}
+
+void Level::AttackerLeft()
+{
+  mAttackers[0]->Leave();
+}
+
+void Level::AttackerArrived(uint32_t door)
+{
+  mAttackers[0]->Arrive(mDoors.at(door)->Pos());
+}
+
+void Level::SetThreadPool(ThreadPool* pool)
+{
+  mPool = pool;
+}
+
 bool Level::Run()
 {
+  UpdateCrowd();
+  UpdateDoors();
+  UpdateAttacker();
+
+  return true;
+}
+
+void Level::UpdateCrowd()
+{
+  if (!mPool)
+  {
+    for (auto& guard : mGuards)
+      guard->Update();
+
+    for (auto& employee : mEmployees)
+      employee->Update();
+
+    return;
+  }
+
+  // Guards only read positions while looking for someone to check
+  mPool->ParallelFor(mGuards.size(), [this](uint32_t i){ mGuards[i]->FindCandidates(); });
+
+  // Starting and stopping checks changes other entities, keep the serial order
   for (auto& guard : mGuards)
-    guard->Update();
+    guard->Resolve();
 
-  for (auto& employee : mEmployees)
-    employee->Update();
+  // From here on every entity only touches its own state
+  mPool->ParallelFor(mGuards.size(), [this](uint32_t i){ mGuards[i]->Walk(); });
+  mPool->ParallelFor(mEmployees.size(), [this](uint32_t i){ mEmployees[i]->Update(); });
+}
 
+void Level::UpdateDoors()
+{
   for (auto& door : mDoors)
     door->Update();
+}
 
-  mAttacker->Update();
-
-  UpdateWalls();
+void Level::UpdateAttacker()
+{
+  for (uint32_t i = 0; i < mAttackers.size(); ++i)
+  {
+    if (mActive[i] && mAttackers[i]->IsPresent())
+      mAttackers[i]->Update();
+  }
+}
 
-  return true;
+DoorStats Level::GetResult(uint32_t replica)
+{
+  return mAttackers.at(replica)->GetStats();
 }
 
 DoorStats Level::GetResult()
@@ -59,70 +230,37 @@ DoorStats Level::GetResult()
   return stats;
 }
 
-void Level::UpdateWalls() const
+const std::vector<Line>& Level::Walls() const
 {
-  if (HIDDEN)
-    return;
-
-  SDL_SetRenderDrawColor(mRenderer, 255, 255, 255, 255);
-  for (auto& wall : mWalls)
-  {
-    // Uncomment to see the dead zones
-    // SDL_RenderFillRect(mRenderer, &wall.deadzone);
-    SDL_RenderDrawLine(mRenderer, wall.p1.x, wall.p1.y, wall.p2.x, wall.p2.y);
-  }
+  return mWalls;
 }
 
-bool Level::CreateWalls(const nlohmann::json& config)
+const std::vector<PDoor>& Level::Doors() const
 {
-  try
-  {
-    for (auto& line : config)
-    {
-      mWalls.push_back(Line(line["x1"], line["y1"], line["x2"], line["y2"]));
-      bool hasX = line.contains("dead_x");
-      bool hasY = line.contains("dead_y");
-      if (!hasX && !hasY)
-        continue;
+  return mDoors;
+}
 
-      if (hasX)
-      {
-        mWalls.back().deadzone.x = line["dead_x"] == "right" ? float(line["x1"]) : 0;
-        mWalls.back().deadzone.w = line["dead_x"] == "right" ? WIDTH - float(line["x1"]) : float(line["x1"]);
-      }
-      else
-      {
-        mWalls.back().deadzone.x = float(line["x1"]);
-        mWalls.back().deadzone.w = float(line["x2"]) - float(line["x1"]);
-      }
+const std::vector<PAttacker>& Level::Attackers() const
+{
+  return mAttackers;
+}
 
-      if (hasY)
-      {
-        mWalls.back().deadzone.y = line["dead_y"] == "bottom" ? float(line["y1"]) : 0;
-        mWalls.back().deadzone.h = line["dead_y"] == "bottom" ? HEIGHT - float(line["y1"]) : float(line["y2"]);
-      }
-      else
-      {
-        mWalls.back().deadzone.y = float(line["y1"]);
-        mWalls.back().deadzone.h = float(line["y2"]) - float(line["y1"]);
-      }
-    }
-  }
-  catch (const std::exception& e)
-  {
-    std::cerr << e.what() << std::endl;
-    return false;
-  }
+const std::vector<PGuard>& Level::Guards() const
+{
+  return mGuards;
+}
 
-  return true;
+const std::vector<PEmployee>& Level::Employees() const
+{
+  return mEmployees;
 }
 
-bool Level::CreateDoors(const nlohmann::json& config, SDL_Renderer* renderer)
+bool Level::CreateDoors(const std::vector<DoorConfig>& config)
 {
   try
   {
     for (uint32_t i = 0; i < config.size(); i++)
-      mDoors.push_back(std::make_shared<Door>(i, config[i], renderer));
+      mDoors.push_back(std::make_shared<Door>(i, config[i], mSettings));
   }
   catch (const std::exception& e)
   {
@@ -133,21 +271,24 @@ bool Level::CreateDoors(const nlohmann::json& config, SDL_Renderer* renderer)
   return true;
 }
 
-bool Level::CreateGuards(const nlohmann::json& config, SDL_Renderer* renderer)
+bool Level::CreateGuards(const std::vector<GuardConfig>& config)
 {
   // Create list of movables so guard can iterate through attackers and employees as one
   std::vector<PMovable> movables(mEmployees.begin(), mEmployees.end());
-  movables.push_back(mAttacker);
+
+  // Replicas must not change the level, guards only pretend to check them
+  std::vector<PMovable> replicas;
+  if (mAttackers.size() > 1)
+    replicas.assign(mAttackers.begin(), mAttackers.end());
+  else
+    movables.push_back(mAttackers[0]);
 
   try
   {
-    uint32_t index = 0;
-    auto nGuards = config["number_of_guards"];
-    for (uint32_t i = 0; i < nGuards; ++i)
+    for (uint32_t i = 0; i < config.size(); ++i)
     {
-      index = config["config"].size() == 1 ? 0 : index;
-      mGuards.push_back(std::make_shared<Guard>(i, config["config"][index], movables, mWalls, renderer));
-      index++;
+      mGuards.push_back(std::make_shared<Guard>(i, config[i], movables, *mNavigation, mSettings));
+      mGuards.back()->SetReplicas(replicas);
     }
   }
   catch (const std::exception& e)
@@ -160,13 +301,29 @@ bool Level::CreateGuards(const nlohmann::json& config, SDL_Renderer* renderer)
   return true;
 }
 
-bool Level::CreateAttacker(const nlohmann::json& config, SDL_Renderer* renderer)
+bool Level::CreateAttackers(const AttackerConfig& config, uint32_t replicas)
 {
   try
   {
-    mAttacker = std::make_shared<Attacker>(config, mDoors, mWalls, renderer);
-    mAttacker->mReachedDoor = mReachedDoor;
-    mAttacker->mWasCaught = mWasCaught;
+    for (uint32_t i = 0; i < replicas; ++i)
+    {
+      auto attacker = std::make_shared<Attacker>(config, mDoors, *mNavigation, mSettings);
+      if (replicas > 1)
+      {
+        attacker->mReachedDoor = [this, i]{ ReplicaFinished(i, true); };
+        attacker->mWasCaught = [this, i]{ ReplicaFinished(i, false); };
+      }
+      else
+      {
+        attacker->mReachedDoor = mReachedDoor;
+        attacker->mWasCaught = mWasCaught;
+        attacker->mChangeFloor = mChangeFloor;
+      }
+
+      mAttackers.push_back(attacker);
+    }
+
+    mActive.assign(replicas, 1);
   }
   catch (const std::exception& e)
   {
@@ -177,13 +334,23 @@ bool Level::CreateAttacker(const nlohmann::json& config, SDL_Renderer* renderer)
   return true;
 }
 
-bool Level::CreateEmployees(const nlohmann::json& config, SDL_Renderer* renderer)
+void Level::ReplicaFinished(uint32_t replica, bool result)
+{
+  // A replica stops moving once done, but guards may still run into it
+  if (!mActive[replica])
+    return;
+
+  mActive[replica] = 0;
+  if (mReplicaFinished)
+    mReplicaFinished(replica, result);
+}
+
+bool Level::CreateEmployees(const EmployeeConfig& config)
 {
   try
   {
-    auto nEmployees = config["number_of_employees"];
-    for (uint32_t i = 0; i < nEmployees; ++i)
-      mEmployees.push_back(std::make_shared<Employee>(i, config, mWalls, renderer));
+    for (uint32_t i = 0; i < config.count; ++i)
+      mEmployees.push_back(std::make_shared<Employee>(i, config, *mNavigation, mSettings));
   }
   catch (const std::exception& e)
   {
@@ -4,44 +4,102 @@
 #include <string>
 #include <vector>
 
-#include <nlohmann/json.hpp>
-#include <SDL2/SDL.h>
-
 #include "attacker.h"
+#include "blueprint.h"
 #include "door.h"
 #include "employee.h"
 #include "guard.h"
+#include "thread_pool.h"
+
+// Complete state of a level between two ticks
+struct LevelSnapshot
+{
+  std::vector<Door::Snapshot> doors;
+  std::vector<Attacker::Snapshot> attackers;
+  std::vector<Employee::Snapshot> employees;
+  std::vector<Guard::Snapshot> guards;
+};
 
 class Level
 {
 public:
-  Level(SDL_Renderer* renderer);
+  Level(const Settings& settings);
   ~Level();
 
-  bool Init(const nlohmann::json& config);
+  // With more than one replica, that many attackers walk through the same
+  // level without affecting it or each other and report to mReplicaFinished
+  bool Init(const Blueprint& blueprint, uint32_t replicas = 1);
   bool Run();
 
+  // Parts of Run, for callers which time each part
+  void UpdateCrowd();
+  void UpdateDoors();
+  void UpdateAttacker();
+
+  // Bring every entity back to its initial state, resampling its random
+  // parameters, without reallocating anything
+  bool Reset();
+
+  // Store and bring back the state of every entity, random sequences included.
+  // A restored level repeats the same future unless it is reseeded afterwards
+  void Save(LevelSnapshot& snapshot) const;
+  void Restore(const LevelSnapshot& snapshot);
+
+  // Restart the random sequences of every entity from key, the same key
+  // followed by Reset always gives the same iteration. Mirrored sequences
+  // give the antithetic twin of that iteration
+  void Reseed(uint64_t key, bool mirrored = false);
+
+  // Reseed for an iteration of the batch with the given key. With
+  // antithetic pairs every odd iteration mirrors the one before it
+  void ReseedIteration(uint64_t batchKey, uint32_t iteration);
+
+  // Distance from the first attacker to the closest open door in tiles, FLT_MAX if all are closed
+  float DistanceToOpenDoor() const;
+
+  // Take the attacker off this floor, or let it come in through one of its doors
+  void AttackerLeft();
+  void AttackerArrived(uint32_t door);
+
+  // Spread entity updates over the pool, only valid when nothing is rendered
+  void SetThreadPool(ThreadPool* pool);
+
   DoorStats GetResult();
 
+  // Read only access for the display
+  const std::vector<Line>& Walls() const;
+  const std::vector<PDoor>& Doors() const;
+  const std::vector<PAttacker>& Attackers() const;
+  const std::vector<PGuard>& Guards() const;
+  const std::vector<PEmployee>& Employees() const;
+
+  // Doors entered and blocked by a single attacker replica
+  DoorStats GetResult(uint32_t replica);
+
   std::function<void()> mReachedDoor;
   std::function<void()> mWasCaught;
+  std::function<void(uint32_t replica, bool result)> mReplicaFinished;
+  std::function<void(int32_t floor, int32_t door)> mChangeFloor;
 
 private:
-  PAttacker mAttacker;
+  std::vector<PAttacker> mAttackers;
+  std::vector<uint8_t> mActive;
 
   std::vector<PDoor> mDoors;
   std::vector<PGuard> mGuards;
   std::vector<PEmployee> mEmployees;
 
   std::vector<Line> mWalls;
+  PNavGrid mNavigation;
 
-  SDL_Renderer* mRenderer;
+  // Entities refer to this copy, so it has to outlive all of them
+  const Settings mSettings;
 
-  void UpdateWalls() const;
+  ThreadPool* mPool;
 
-  bool CreateWalls(const nlohmann::json& config);
-  bool CreateDoors(const nlohmann::json& config, SDL_Renderer* renderer);
-  bool CreateGuards(const nlohmann::json& config, SDL_Renderer* renderer);
-  bool CreateAttacker(const nlohmann::json& config, SDL_Renderer* renderer);
-  bool CreateEmployees(const nlohmann::json& config, SDL_Renderer* renderer);
+  bool CreateDoors(const std::vector<DoorConfig>& config);
+  bool CreateGuards(const std::vector<GuardConfig>& config);
+  bool CreateAttackers(const AttackerConfig& config, uint32_t replicas);
+  void ReplicaFinished(uint32_t replica, bool result);
+  bool CreateEmployees(const EmployeeConfig& config);
 };
\ No newline at end of file
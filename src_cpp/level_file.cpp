@@ -0,0 +1,366 @@
+#include "level_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "helpers.h"
+
+static const char LEVEL_FILE_MAGIC[8] = { 'I', 'G', 'L', 'E', 'V', 'E', 'L', '\0' };
+
+enum SectionId : uint32_t
+{
+  SECTION_PARAMS = 0,
+  SECTION_NAME,
+  SECTION_TEST_TYPE,
+  SECTION_WALLS,
+  SECTION_DOORS,
+  SECTION_GUARDS,
+  SECTION_ATTACKER_POSITIONS,
+  SECTION_PASSABLE,
+  SECTION_FREE_TILES,
+  SECTION_VISIBLE,
+  SECTION_COUNT
+};
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t sections;
+
+  // Record sizes, a mismatch means the file was written by another build
+  uint32_t lineSize;
+  uint32_t doorSize;
+  uint32_t guardSize;
+  uint32_t paramsSize;
+};
+
+struct SectionEntry
+{
+  uint32_t id;
+  uint32_t count;
+  uint64_t offset;
+  uint64_t bytes;
+};
+
+struct LevelParams
+{
+  float observedMean;
+
+  uint32_t fps;
+  uint32_t iterations;
+  uint32_t cyclesPerFrame;
+  uint32_t dayDuration;
+
+  uint32_t tileSize;
+  uint32_t width;
+  uint32_t height;
+
+  EmployeeConfig employees;
+
+  AttackerConfig::Strategy strategy;
+  AttackerConfig::Behaviour behaviour;
+  int speed;
+  int attackSpeed;
+  float stayPeriod;
+  float attackPeriod;
+};
+
+static_assert(std::is_trivially_copyable<Line>::value, "Walls are stored as raw records");
+static_assert(std::is_trivially_copyable<Point>::value, "Points are stored as raw records");
+static_assert(std::is_trivially_copyable<DoorConfig>::value, "Doors are stored as raw records");
+static_assert(std::is_trivially_copyable<GuardConfig>::value, "Guards are stored as raw records");
+static_assert(std::is_trivially_copyable<LevelParams>::value, "Parameters are stored as a raw record");
+
+// Read only view of a whole file, unmapped when the last user is gone
+class MappedFile
+{
+public:
+  MappedFile()
+      : mData(nullptr)
+      , mSize(0)
+  {
+  }
+
+  ~MappedFile()
+  {
+    if (mData)
+      munmap(mData, mSize);
+  }
+
+  bool Open(const std::string& filename)
+  {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      close(fd);
+      return false;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+      return false;
+
+    mData = data;
+    mSize = st.st_size;
+    return true;
+  }
+
+  const uint8_t* Data() const
+  {
+    return static_cast<const uint8_t*>(mData);
+  }
+
+  size_t Size() const
+  {
+    return mSize;
+  }
+
+private:
+  void* mData;
+  size_t mSize;
+};
+
+class SectionWriter
+{
+public:
+  template <typename T>
+  void Add(SectionId id, const T* data, size_t count)
+  {
+    SectionEntry entry;
+    entry.id = id;
+    entry.count = count;
+    entry.offset = 0;
+    entry.bytes = count * sizeof(T);
+
+    mEntries.push_back(entry);
+    mPayloads.push_back(std::string(reinterpret_cast<const char*>(data), entry.bytes));
+  }
+
+  bool Write(const std::string& filename)
+  {
+    FileHeader header;
+    std::memcpy(header.magic, LEVEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = LEVEL_FILE_VERSION;
+    header.sections = mEntries.size();
+    header.lineSize = sizeof(Line);
+    header.doorSize = sizeof(DoorConfig);
+    header.guardSize = sizeof(GuardConfig);
+    header.paramsSize = sizeof(LevelParams);
+
+    uint64_t offset = Align(sizeof(FileHeader) + mEntries.size() * sizeof(SectionEntry));
+    for (auto& entry : mEntries)
+    {
+      entry.offset = offset;
+      offset = Align(offset + entry.bytes);
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    LOG_AND_RETURN_ON_FAILURE(file.is_open(), std::string("Could not open file: " + filename).c_str());
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(mEntries.data()), mEntries.size() * sizeof(SectionEntry));
+
+    for (uint32_t i = 0; i < mEntries.size(); ++i)
+    {
+      Pad(file, mEntries[i].offset);
+      file.write(mPayloads[i].data(), mPayloads[i].size());
+    }
+
+    return file.good();
+  }
+
+private:
+  std::vector<SectionEntry> mEntries;
+  std::vector<std::string> mPayloads;
+
+  static uint64_t Align(uint64_t offset)
+  {
+    return (offset + 7) & ~uint64_t(7);
+  }
+
+  static void Pad(std::ofstream& file, uint64_t offset)
+  {
+    while (uint64_t(file.tellp()) < offset)
+      file.put('\0');
+  }
+};
+
+// Returns the payload of a section if it holds exactly count records of T
+template <typename T>
+static const T* GetSection(const MappedFile& file, const SectionEntry* entries, uint32_t sections, SectionId id, uint32_t& count)
+{
+  for (uint32_t i = 0; i < sections; ++i)
+  {
+    const SectionEntry& entry = entries[i];
+    if (entry.id != id)
+      continue;
+
+    if (entry.bytes != uint64_t(entry.count) * sizeof(T) || entry.offset % alignof(T) != 0)
+      return nullptr;
+
+    if (entry.offset > file.Size() || entry.bytes > file.Size() - entry.offset)
+      return nullptr;
+
+    count = entry.count;
+    return reinterpret_cast<const T*>(file.Data() + entry.offset);
+  }
+
+  return nullptr;
+}
+
+bool IsCompiledLevel(const std::string& filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  char magic[sizeof(LEVEL_FILE_MAGIC)] = {};
+  file.read(magic, sizeof(magic));
+
+  return file.good() && std::memcmp(magic, LEVEL_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool SaveCompiledLevel(const std::string& filename, const Blueprint& blueprint)
+{
+  LOG_AND_RETURN_ON_FAILURE(blueprint.navigation, "Blueprint has no navigation data");
+  const NavGrid& nav = *blueprint.navigation;
+
+  // Value initialised, so the padding written to the file is zero too
+  LevelParams params{};
+  params.observedMean = blueprint.observedMean;
+  params.fps = blueprint.fps;
+  params.iterations = blueprint.iterations;
+  params.cyclesPerFrame = blueprint.cyclesPerFrame;
+  params.dayDuration = blueprint.dayDuration;
+  params.tileSize = blueprint.tileSize;
+  params.width = blueprint.width;
+  params.height = blueprint.height;
+  params.employees = blueprint.employees;
+  params.strategy = blueprint.attacker.strategy;
+  params.behaviour = blueprint.attacker.behaviour;
+  params.speed = blueprint.attacker.speed;
+  params.attackSpeed = blueprint.attacker.attackSpeed;
+  params.stayPeriod = blueprint.attacker.stayPeriod;
+  params.attackPeriod = blueprint.attacker.attackPeriod;
+
+  SectionWriter writer;
+  writer.Add(SECTION_PARAMS, &params, 1);
+  writer.Add(SECTION_NAME, blueprint.level.data(), blueprint.level.size());
+  writer.Add(SECTION_TEST_TYPE, blueprint.testType.data(), blueprint.testType.size());
+  writer.Add(SECTION_WALLS, blueprint.walls.data(), blueprint.walls.size());
+  writer.Add(SECTION_DOORS, blueprint.doors.data(), blueprint.doors.size());
+  writer.Add(SECTION_GUARDS, blueprint.guards.data(), blueprint.guards.size());
+  writer.Add(SECTION_ATTACKER_POSITIONS, blueprint.attacker.positions.data(), blueprint.attacker.positions.size());
+  writer.Add(SECTION_PASSABLE, nav.PassableData(), nav.Nodes());
+  writer.Add(SECTION_FREE_TILES, nav.FreeTileData(), nav.Tiles());
+  if (nav.VisibleData())
+    writer.Add(SECTION_VISIBLE, nav.VisibleData(), nav.VisibilityWords());
+
+  return writer.Write(filename);
+}
+
+bool LoadCompiledLevel(const std::string& filename, Blueprint& blueprint)
+{
+  auto file = std::make_shared<MappedFile>();
+  LOG_AND_RETURN_ON_FAILURE(file->Open(filename), std::string("Could not map file: " + filename).c_str());
+
+  LOG_AND_RETURN_ON_FAILURE(file->Size() >= sizeof(FileHeader), "Compiled level is truncated");
+
+  FileHeader header;
+  std::memcpy(&header, file->Data(), sizeof(header));
+
+  LOG_AND_RETURN_ON_FAILURE(std::memcmp(header.magic, LEVEL_FILE_MAGIC, sizeof(header.magic)) == 0, "Not a compiled level");
+  if (header.version != LEVEL_FILE_VERSION ||
+      header.lineSize != sizeof(Line) ||
+      header.doorSize != sizeof(DoorConfig) ||
+      header.guardSize != sizeof(GuardConfig) ||
+      header.paramsSize != sizeof(LevelParams))
+  {
+    printf("Compiled level %s was written by an incompatible version (%u), compile it again\n", filename.c_str(), header.version);
+    return false;
+  }
+
+  LOG_AND_RETURN_ON_FAILURE(file->Size() >= sizeof(FileHeader) + header.sections * sizeof(SectionEntry), "Compiled level is truncated");
+  const SectionEntry* entries = reinterpret_cast<const SectionEntry*>(file->Data() + sizeof(FileHeader));
+
+  uint32_t count = 0;
+  const LevelParams* params = GetSection<LevelParams>(*file, entries, header.sections, SECTION_PARAMS, count);
+  LOG_AND_RETURN_ON_FAILURE(params && count == 1, "Compiled level has no parameters");
+
+  blueprint.observedMean = params->observedMean;
+  blueprint.fps = params->fps;
+  blueprint.iterations = params->iterations;
+  blueprint.cyclesPerFrame = params->cyclesPerFrame;
+  blueprint.dayDuration = params->dayDuration;
+  blueprint.tileSize = params->tileSize;
+  blueprint.width = params->width;
+  blueprint.height = params->height;
+  blueprint.employees = params->employees;
+  blueprint.attacker.strategy = params->strategy;
+  blueprint.attacker.behaviour = params->behaviour;
+  blueprint.attacker.speed = params->speed;
+  blueprint.attacker.attackSpeed = params->attackSpeed;
+  blueprint.attacker.stayPeriod = params->stayPeriod;
+  blueprint.attacker.attackPeriod = params->attackPeriod;
+
+  const char* name = GetSection<char>(*file, entries, header.sections, SECTION_NAME, count);
+  LOG_AND_RETURN_ON_FAILURE(name, "Compiled level has no name");
+  blueprint.level.assign(name, count);
+
+  const char* testType = GetSection<char>(*file, entries, header.sections, SECTION_TEST_TYPE, count);
+  LOG_AND_RETURN_ON_FAILURE(testType, "Compiled level has no test type");
+  blueprint.testType.assign(testType, count);
+
+  const Line* walls = GetSection<Line>(*file, entries, header.sections, SECTION_WALLS, count);
+  LOG_AND_RETURN_ON_FAILURE(walls, "Compiled level has no walls");
+  blueprint.walls.assign(walls, walls + count);
+
+  const DoorConfig* doors = GetSection<DoorConfig>(*file, entries, header.sections, SECTION_DOORS, count);
+  LOG_AND_RETURN_ON_FAILURE(doors, "Compiled level has no doors");
+  blueprint.doors.assign(doors, doors + count);
+
+  const GuardConfig* guards = GetSection<GuardConfig>(*file, entries, header.sections, SECTION_GUARDS, count);
+  LOG_AND_RETURN_ON_FAILURE(guards, "Compiled level has no guards");
+  blueprint.guards.assign(guards, guards + count);
+
+  const Point* positions = GetSection<Point>(*file, entries, header.sections, SECTION_ATTACKER_POSITIONS, count);
+  LOG_AND_RETURN_ON_FAILURE(positions && count > 0, "Compiled level has no attacker positions");
+  blueprint.attacker.positions.assign(positions, positions + count);
+
+  // The navigation tables are used in place, straight from the mapping
+  uint32_t passableCount = 0;
+  uint32_t freeCount = 0;
+  uint32_t visibleCount = 0;
+  const uint8_t* passable = GetSection<uint8_t>(*file, entries, header.sections, SECTION_PASSABLE, passableCount);
+  const uint8_t* freeTiles = GetSection<uint8_t>(*file, entries, header.sections, SECTION_FREE_TILES, freeCount);
+  const uint64_t* visible = GetSection<uint64_t>(*file, entries, header.sections, SECTION_VISIBLE, visibleCount);
+
+  auto grid = std::make_shared<NavGrid>();
+  LOG_AND_RETURN_ON_FAILURE(grid->Attach(blueprint.width, blueprint.height, blueprint.tileSize, blueprint.walls,
+                                         passable, freeTiles, visible, file),
+                            "Compiled level has no navigation data");
+
+  if (passableCount != grid->Nodes() || freeCount != grid->Tiles() ||
+      (visible && visibleCount != grid->VisibilityWords()))
+  {
+    printf("Navigation data in %s does not match the level size\n", filename.c_str());
+    return false;
+  }
+
+  blueprint.navigation = grid;
+
+  return true;
+}
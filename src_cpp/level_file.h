@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "blueprint.h"
+
+// Compiled level files hold a blueprint together with its navigation tables,
+// so the simulator can map them into memory instead of parsing JSON and
+// recomputing the grid on every start.
+//
+// Layout: a fixed header, a table of sections and the section payloads, each
+// payload aligned to 8 bytes. Files are only meant to be read by the same
+// build that wrote them; the version and record sizes are checked on load.
+
+static const uint32_t LEVEL_FILE_VERSION = 2;
+
+bool IsCompiledLevel(const std::string& filename);
+
+bool SaveCompiledLevel(const std::string& filename, const Blueprint& blueprint);
+bool LoadCompiledLevel(const std::string& filename, Blueprint& blueprint);
@@ -1,17 +1,571 @@
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <memory>
+#include <random>
+#include <thread>
 
 #include <argumentum/argparse.h>
 
+#include "batch_runner.h"
+#include "blueprint.h"
 #include "game.h"
 #include "helpers.h"
+#include "level_file.h"
+#include "metrics.h"
+#include "replay.h"
+#include "result_cache.h"
+#include "search.h"
+#include "simulation.h"
 #include "statistics.h"
+#include "sweep.h"
 
 using namespace argumentum;
 using json = nlohmann::json;
 
+static bool ApplyOverride(json& configs, const Args& args)
+{
+  if (args.entity.empty() || args.parameter.empty())
+    return true;
+
+  printf("Overwriting %s in %s to %.2f\n", args.parameter.c_str(), args.entity.c_str(), args.value);
+  try
+  {
+    if (args.entity == "guards")
+    {
+      if (args.parameter == "number_of_guards")
+      {
+        configs[args.entity][args.parameter] = args.value;
+      }
+      else
+      {
+        for (auto& c : configs[args.entity]["config"])
+          c[args.parameter] = args.value;
+      }
+    }
+    else
+    {
+      configs[args.entity][args.parameter] = args.value;
+    }
+  }
+  catch (const std::exception& e)
+  {
+    printf("Error: %s\n", e.what());
+    return false;
+  }
+
+  return true;
+}
+
+static bool LoadBlueprint(const std::string& configFile, const Args& args, Blueprint& blueprint)
+{
+  if (IsCompiledLevel(configFile))
+  {
+    if (!args.entity.empty() || !args.parameter.empty())
+    {
+      printf("Parameters of a compiled level cannot be overwritten, use the JSON config instead\n");
+      return false;
+    }
+
+    return LoadCompiledLevel(configFile, blueprint);
+  }
+
+  std::ifstream f(configFile);
+  if (!f.is_open())
+  {
+    printf("Could not open file: %s\n", configFile.c_str());
+    return false;
+  }
+
+  auto configs = json::parse(f);
+
+  // Buildings only list their floors, overrides apply to every floor
+  if (configs.contains("floors"))
+  {
+    std::vector<Blueprint> floors;
+    for (const auto& floor : configs["floors"])
+    {
+      floors.push_back(Blueprint());
+      if (!LoadBlueprint(RemoveFilename(configFile) + std::string(floor), args, floors.back()))
+        return false;
+    }
+
+    if (!blueprint.InitBuilding(configs, floors))
+    {
+      printf("Invalid building file: %s\n", configFile.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  if (!ApplyOverride(configs, args))
+    return false;
+
+  if (!blueprint.Init(configs))
+  {
+    printf("Invalid configuration file: %s\n", configFile.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+static bool ParseList(const std::string& text, std::vector<float>& values)
+{
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ','))
+  {
+    try
+    {
+      values.push_back(std::stof(item));
+    }
+    catch (const std::exception& e)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// False in builds with COUNT_ALLOCATIONS when the ticks of a hidden run
+// allocated after the first iteration, which grows every reused buffer
+static bool BatchDone(uint32_t batch, const Args& args, uint32_t iterations, uint64_t allocations, Statistics& stats)
+{
+  if (args.timeBudget > 0)
+    printf("Done with %u batches\n", batch + 1);
+  else
+    printf("Done with %u out of %u batches\n", batch + 1, args.batches);
+#ifdef COUNT_ALLOCATIONS
+  printf("Allocations during the ticks of the last iteration: %lu\n", allocations);
+#endif
+  stats.Dump();
+  ReportEstimate(stats);
+
+#ifdef COUNT_ALLOCATIONS
+  if (args.hidden && iterations > 1 && allocations > 0)
+  {
+    printf("Ticks allocated after the first iteration\n");
+    return false;
+  }
+#endif
+
+  return true;
+}
+
+// Batches run with --target-halfwidth before their interval is trusted
+static const uint32_t MIN_SEQUENTIAL_BATCHES = 10;
+
+// Whether the batches so far are enough for --target-halfwidth. Batches are
+// checked in batch order, so runs stop at the same batch with any --threads
+static bool IsPreciseEnough(const Args& args, const Statistics& stats)
+{
+  return args.targetHalfWidth > 0 && stats.Batches() >= MIN_SEQUENTIAL_BATCHES &&
+         stats.ReachedHalfWidth(args.confidence, args.targetHalfWidth);
+}
+
+// First and one past the last batch of the shard picked with --shard, the
+// shards of a run are disjoint and together cover every batch
+static void ShardBatches(const Args& args, uint32_t& first, uint32_t& end)
+{
+  first = uint64_t(args.batches) * args.shard / args.shards;
+  end = uint64_t(args.batches) * (args.shard + 1) / args.shards;
+}
+
+// Simulate args.threads batches at a time, each with a simulation of its own. Every
+// batch is collected separately and merged in batch order, so the output is
+// the same whatever the number of threads
+static bool RunParallelBatches(const Blueprint& blueprint, const Args& args, uint32_t iterations, Statistics& stats, bool verbose)
+{
+  uint32_t first, end;
+  ShardBatches(args, first, end);
+
+  BatchRunner runner(args.threads);
+  for (uint32_t i = first; i < end; ++i)
+    runner.Add(blueprint, args, i, iterations);
+
+  runner.Start();
+
+  for (uint32_t i = first; i < end; ++i)
+  {
+    auto batch = runner.Next();
+    if (!batch.ok)
+      return false;
+
+    stats.Merge(*batch.stats);
+
+    if (verbose && !BatchDone(i, args, iterations, batch.allocations, stats))
+      return false;
+
+    // Batches still running are waited for and thrown away
+    if (IsPreciseEnough(args, stats))
+      break;
+  }
+
+  return true;
+}
+
+// Keep args.threads batches going until the time budget is spent. Only the
+// batches before the first one stopped by the deadline are used, so batches
+// that happen to be quick are not favoured over slow ones
+static bool RunBudgetedBatches(const Blueprint& blueprint, const Args& args, uint32_t iterations, Statistics& stats, bool verbose)
+{
+  auto budget = std::chrono::duration<float>(args.timeBudget);
+
+  BatchRunner runner(args.threads);
+  runner.SetDeadline(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget));
+
+  // One batch waiting for every thread, so none of them runs dry
+  uint32_t queued = 0;
+  for (; queued < 2 * args.threads; ++queued)
+    runner.Add(blueprint, args, queued, iterations);
+
+  runner.Start();
+
+  for (uint32_t i = 0; ; ++i)
+  {
+    auto batch = runner.Next();
+    if (!batch.ok)
+      return false;
+
+    if (!batch.finished)
+      break;
+
+    // Estimates use the batch method as soon as there are batches to compare
+    stats.Merge(*batch.stats);
+    stats.SetBatches(stats.Batches());
+    runner.Add(blueprint, args, queued++, iterations);
+
+    if (verbose && !BatchDone(i, args, iterations, batch.allocations, stats))
+      return false;
+
+    if (IsPreciseEnough(args, stats))
+      break;
+  }
+
+  return true;
+}
+
+// Run every batch of a loaded level into stats, stops early if the window is closed
+static bool RunBatches(const Blueprint& blueprint, const Args& args, uint32_t iterations, Statistics& stats, bool verbose)
+{
+  // Only the display uses SDL, which is not thread safe
+  if (args.timeBudget > 0 && args.hidden)
+    return RunBudgetedBatches(blueprint, args, iterations, stats, verbose);
+
+  if (args.threads > 1 && args.hidden)
+    return RunParallelBatches(blueprint, args, iterations, stats, verbose);
+
+  if (args.timeBudget > 0)
+    printf("Ignoring --time-budget, it requires --hidden\n");
+
+  if (args.threads > 1)
+    printf("Ignoring --threads, it requires --hidden\n");
+
+  uint32_t first, end;
+  ShardBatches(args, first, end);
+
+  bool running = true;
+  for (uint32_t i = first; running && i < end; ++i)
+  {
+    std::unique_ptr<Simulation> simulation = std::make_unique<Simulation>(blueprint, i);
+    if (!simulation->Init(args))
+      return false;
+
+    if (args.hidden)
+    {
+      running = simulation->RunBatch(iterations, stats);
+    }
+    else
+    {
+      Game game(*simulation);
+      if (!game.Init())
+        return false;
+
+      // The batch runs on a thread of its own while this one draws it
+      running = game.Run([&]{ return simulation->RunBatch(iterations, stats); });
+    }
+
+    if (verbose && !BatchDone(i, args, iterations, simulation->TickAllocations(), stats))
+      return false;
+
+    if (IsPreciseEnough(args, stats))
+      break;
+  }
+
+  return true;
+}
+
+// Run every level of a directory with the exact and the coarse time step
+// and show how far the coarse estimates drift away from the exact ones
+static int TimeStepReport(const std::string& directory, const Args& args)
+{
+  std::vector<std::string> configFiles;
+  DIR* dir = opendir(directory.c_str());
+  if (!dir)
+  {
+    printf("Could not open directory: %s\n", directory.c_str());
+    return 1;
+  }
+
+  while (struct dirent* entry = readdir(dir))
+  {
+    std::string name = entry->d_name;
+    if (name.size() > 5 && name.substr(name.size() - 5) == ".json")
+      configFiles.push_back(directory + "/" + name);
+  }
+  closedir(dir);
+  std::sort(configFiles.begin(), configFiles.end());
+
+  Args exact = args;
+  exact.timeStep = 1;
+  exact.hidden = true;
+
+  Args coarse = exact;
+  coarse.timeStep = args.timeStep;
+
+  printf("%-16s %-7s %10s %10s %10s %10s %9s\n", "level", "test", "exact", "dt", "drift", "std err", "speedup");
+
+  for (const auto& configFile : configFiles)
+  {
+    Blueprint blueprint;
+    if (!LoadBlueprint(configFile, args, blueprint))
+      continue;
+
+    uint32_t iterations = args.iterations > 0 ? args.iterations : blueprint.iterations;
+
+    auto start = std::chrono::steady_clock::now();
+    Statistics exactStats(blueprint.testType, blueprint.dayDuration, args.batches, iterations);
+    if (!RunBatches(blueprint, exact, iterations, exactStats, false))
+      continue;
+
+    auto middle = std::chrono::steady_clock::now();
+    Statistics coarseStats(blueprint.testType, blueprint.dayDuration, args.batches, iterations);
+    if (!RunBatches(blueprint, coarse, iterations, coarseStats, false))
+      continue;
+
+    auto end = std::chrono::steady_clock::now();
+
+    auto e = exactStats.GetStats();
+    auto c = coarseStats.GetStats();
+
+    // Both runs are independent, so the error of the difference adds up
+    float error = std::sqrt(e.variance / e.count + c.variance / c.count);
+    float speedup = std::chrono::duration<float>(middle - start).count() / std::chrono::duration<float>(end - middle).count();
+
+    printf("%-16s %-7s %10.6f %10.6f %+10.6f %10.6f %8.2fx\n", GetFilename(configFile).c_str(), blueprint.testType.c_str(),
+           e.mean, c.mean, c.mean - e.mean, error, speedup);
+  }
+
+  return 0;
+}
+
+// compile-level: turn a JSON level into a binary file that loads without parsing
+static int CompileLevel(int argc, char **argv)
+{
+  Args args;
+  std::string configFile;
+  std::string outFile;
+
+  auto parser = argument_parser{};
+  auto params = parser.params();
+  parser.config().program(std::string(argv[0]) + " compile-level").description("Compile a level into a binary file");
+  params.add_parameter(configFile, "-c", "--config")
+    .nargs(1)
+    .help("Config file to be compiled");
+  params.add_parameter(outFile, "-o", "--output")
+    .nargs(1)
+    .absent("")
+    .help("Output file, defaults to the config file with a .lvl extension");
+
+  if (!parser.parse_args(argc, argv, 1))
+    return 1;
+
+  if (configFile.empty())
+  {
+    printf("No configuration file provided\n");
+    return 1;
+  }
+
+  if (outFile.empty())
+    outFile = RemoveFilename(configFile) + GetFilename(configFile) + ".lvl";
+
+  Blueprint blueprint;
+  if (!LoadBlueprint(configFile, args, blueprint))
+    return 1;
+
+  if (!blueprint.floors.empty())
+  {
+    printf("Buildings cannot be compiled, compile their floors instead\n");
+    return 1;
+  }
+
+  if (!SaveCompiledLevel(outFile, blueprint))
+  {
+    printf("Failed to write compiled level: %s\n", outFile.c_str());
+    return 1;
+  }
+
+  printf("Compiled %s into %s\n", configFile.c_str(), outFile.c_str());
+  return 0;
+}
+
+// merge: combine the partial files written with --shard into the output and
+// Z-test of a run that simulated every batch in one process
+static int MergeShards(int argc, char **argv)
+{
+  std::vector<std::string> partialFiles;
+  std::string outDirectory;
+  std::string confidence;
+  float observed;
+
+  auto parser = argument_parser{};
+  auto params = parser.params();
+  parser.config().program(std::string(argv[0]) + " merge").description("Merge the partial files of a sharded run");
+  params.add_parameter(partialFiles, "partials")
+    .minargs(1)
+    .help("Partial files of every shard, in any order");
+  params.add_parameter(outDirectory, "--out-dir")
+    .nargs(1)
+    .absent("../data/")
+    .help("Output directory");
+  params.add_parameter(observed, "-o")
+    .nargs(1)
+    .absent(-1.0)
+    .help("Expected Z-test mean");
+  params.add_parameter(confidence, "--confidence")
+    .nargs(1)
+    .absent("0.75")
+    .help("Confidence to use in Z-test");
+
+  if (!parser.parse_args(argc, argv, 1))
+    return 1;
+
+  std::vector<json> partials;
+  for (const auto& partialFile : partialFiles)
+  {
+    std::ifstream f(partialFile);
+    if (!f.is_open())
+    {
+      printf("Could not open file: %s\n", partialFile.c_str());
+      return 1;
+    }
+
+    try
+    {
+      partials.push_back(json::parse(f));
+      partials.back().at("shard").get<uint32_t>();
+    }
+    catch (const std::exception& e)
+    {
+      printf("Invalid partial file %s: %s\n", partialFile.c_str(), e.what());
+      return 1;
+    }
+  }
+
+  // Batches have to be merged in the order a single process would have run them
+  std::sort(partials.begin(), partials.end(), [](const json& a, const json& b){ return a["shard"] < b["shard"]; });
+
+  // Everything but the shard itself has to match, the name may contain the date
+  auto runOf = [](const json& partial)
+  {
+    json run = partial;
+    run.erase("shard");
+    run.erase("name");
+    run.erase("batch_stats");
+    return run;
+  };
+
+  const json run = runOf(partials[0]);
+  try
+  {
+    uint32_t shards = run.at("shards");
+    if (partials.size() != shards)
+    {
+      printf("Expected %u partial files, got %zu\n", shards, partials.size());
+      return 1;
+    }
+
+    for (uint32_t i = 0; i < partials.size(); ++i)
+    {
+      if (partials[i]["shard"] != i || runOf(partials[i]) != run)
+      {
+        printf("Partial files do not belong to the same run, or a shard is missing or repeated\n");
+        return 1;
+      }
+    }
+
+    Statistics stats(run.at("test_type"), run.at("day_length"), run.at("batches"), run.at("iterations"));
+    for (const auto& partial : partials)
+    {
+      if (!stats.MergePartial(partial))
+        return 1;
+    }
+
+    printf("Merged %u shards of %s\n", shards, std::string(partials[0].at("name")).c_str());
+    printf("Seed: %lu\n", run.at("seed").get<uint64_t>());
+
+    stats.Save(outDirectory + std::string(partials[0].at("name")) + ".txt");
+
+    observed = observed < 0.0 ? float(run.at("observed_mean")) : observed;
+    stats.ZTest(confidence, observed);
+  }
+  catch (const std::exception& e)
+  {
+    printf("Invalid partial file: %s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
+
+// Show recorded iterations from first on, without simulating them
+static int PlayReplay(const std::string& replayFile, uint32_t first)
+{
+  ReplayPlayer player;
+  if (!player.Load(replayFile))
+    return 1;
+
+  if (first >= player.Iterations())
+  {
+    printf("The replay only has %u iterations\n", player.Iterations());
+    return 1;
+  }
+
+  Game game(player.GetSettings(), player.Walls());
+  if (!game.Init())
+    return 1;
+
+  printf("Space pauses, left and right seek, up and down change the speed\n");
+  game.mKeyPressed = [&player](int32_t key)
+  {
+    if (key == SDLK_SPACE)
+      player.Pause();
+    else if (key == SDLK_RIGHT || key == SDLK_LEFT)
+      player.Seek(key == SDLK_RIGHT);
+    else if (key == SDLK_UP || key == SDLK_DOWN)
+      player.ChangeSpeed(key == SDLK_UP);
+  };
+
+  // Closing the window early is not an error here
+  game.Run([&]{ return player.Play(first, [&game](const Snapshot& snapshot){ return game.Show(snapshot); }); });
+  return 0;
+}
+
 int main (int argc, char **argv)
 {
+  // Subcommands come before any of the simulator options
+  if (argc > 1 && std::string(argv[1]) == "compile-level")
+    return CompileLevel(argc - 1, argv + 1);
+
+  if (argc > 1 && std::string(argv[1]) == "merge")
+    return MergeShards(argc - 1, argv + 1);
+
   Args args;
   std::string configFile;
   std::string outDirectory;
@@ -21,6 +575,37 @@ int main (int argc, char **argv)
   float observed;
   std::string confidence;
 
+  // Only used with the --dt-report option
+  std::string reportDirectory;
+
+  // Only used with the --sweep and --search options
+  std::string sweepFile;
+  std::string searchFile;
+  std::string cacheDirectory;
+
+  // Parsed into args.splitLevels
+  std::string splitAt;
+
+  // Copied into args.seed, negative picks a random one
+  int64_t seed;
+
+  // Copied into args.threads, negative uses every core for hidden runs with --time-budget and one otherwise
+  int64_t threads;
+
+  // Parsed into args.shard and args.shards
+  std::string shard;
+
+  // Turned into args.record once the level is known
+  std::string recordDirectory;
+
+  // Only used with the --replay option
+  std::string replayFile;
+  uint32_t replayIteration;
+
+  // Only used with the --metrics option
+  std::string metricsFile;
+  float metricsInterval;
+
   auto parser = argument_parser{};
   auto params = parser.params();
   parser.config().program(argv[0]).description("Intrusion game simulator");
@@ -39,6 +624,14 @@ int main (int argc, char **argv)
     .nargs(1)
     .absent(1)
     .help("Override number of batches in config");
+  params.add_parameter(args.timeBudget, "--time-budget")
+    .nargs(1)
+    .absent(0)
+    .help("Keep simulating batches of -i iterations for this many seconds instead of -b batches, only with --hidden");
+  params.add_parameter(args.targetHalfWidth, "--target-halfwidth")
+    .nargs(1)
+    .absent(0)
+    .help("Stop before -b batches once the interval at --confidence is this wide on either side of the mean");
   params.add_parameter(args.cycles, "--cycles")
     .nargs(1)
     .absent(0)
@@ -58,9 +651,86 @@ int main (int argc, char **argv)
     .nargs(1)
     .absent("0.75")
     .help("Confidence to use in Z-test");
+  params.add_parameter(args.keepSamples, "--keep-samples")
+    .absent(false)
+    .help("Keep every iteration's sample and save them for sweep and search points of one batch, --config runs of one batch always do");
+  params.add_parameter(seed, "--seed")
+    .nargs(1)
+    .absent(-1)
+    .help("Seed of all random numbers, the same seed repeats every iteration exactly");
   params.add_parameter(args.hidden, "--hidden")
     .absent(false)
     .help("Do not show display when simulating");
+  params.add_parameter(threads, "--threads")
+    .nargs(1)
+    .absent(-1)
+    .help("Batches simulated at the same time, only with --hidden, every core with --time-budget and 1 otherwise by default");
+  params.add_parameter(shard, "--shard")
+    .nargs(1)
+    .absent("")
+    .help("Only run shard i/N of the batches and save a partial file for the merge command");
+  params.add_parameter(args.tickThreads, "--tick-threads")
+    .nargs(1)
+    .absent(1)
+    .help("Threads used to update entities within a tick");
+  params.add_parameter(args.commonRandom, "--common-random")
+    .absent(false)
+    .help("Number the random sequences of entities within their kind, so sweep points with more guards or employees share the rest");
+  params.add_parameter(args.antithetic, "--antithetic")
+    .absent(false)
+    .help("Run every odd iteration on the mirrored random numbers of the one before");
+  params.add_parameter(args.timeStep, "--dt")
+    .nargs(1)
+    .absent(1)
+    .help("Ticks simulated per update, values above 1 trade accuracy for speed");
+  params.add_parameter(reportDirectory, "--dt-report")
+    .nargs(1)
+    .absent("")
+    .help("Compare --dt against the exact simulation for every level in this directory");
+  params.add_parameter(sweepFile, "--sweep")
+    .nargs(1)
+    .absent("")
+    .help("Simulate every point of this sweep file, replaces --config and --chg-*");
+  params.add_parameter(searchFile, "--search")
+    .nargs(1)
+    .absent("")
+    .help("Find the value of a parameter where the estimate crosses a target, replaces --config and --chg-*");
+  params.add_parameter(cacheDirectory, "--cache-dir")
+    .nargs(1)
+    .absent("")
+    .help("Reuse the batches of sweep or search points cached in this directory and cache new ones");
+  params.add_parameter(recordDirectory, "--record")
+    .nargs(1)
+    .absent("")
+    .help("Write a replay of every iteration into this directory, one file per batch");
+  params.add_parameter(replayFile, "--replay")
+    .nargs(1)
+    .absent("")
+    .help("Show the iterations of a replay file written with --record instead of simulating");
+  params.add_parameter(replayIteration, "--replay-iteration")
+    .nargs(1)
+    .absent(0)
+    .help("Iteration of the replay file to start showing from");
+  params.add_parameter(metricsFile, "--metrics")
+    .nargs(1)
+    .absent("")
+    .help("Keep writing live metrics of the run to this file in the Prometheus text format");
+  params.add_parameter(metricsInterval, "--metrics-interval")
+    .nargs(1)
+    .absent(5)
+    .help("Seconds between two writes of the --metrics file");
+  params.add_parameter(args.replicas, "--replicas")
+    .nargs(1)
+    .absent(1)
+    .help("Independent attackers sharing the guards, employees and doors of every iteration");
+  params.add_parameter(splitAt, "--split-at")
+    .nargs(1)
+    .absent("")
+    .help("Comma separated distances to an open door, in tiles, where iterations are split, only with --hidden");
+  params.add_parameter(args.splitFactor, "--split-factor")
+    .nargs(1)
+    .absent(2)
+    .help("Number of branches an iteration is split into at every --split-at distance");
   params.add_parameter(args.parameter, "--chg-param")
     .nargs(1)
     .absent("")
@@ -80,82 +750,266 @@ int main (int argc, char **argv)
     return 1;
   }
 
-  if (configFile.empty())
+  if (!ParseList(splitAt, args.splitLevels))
   {
-    printf("No configuration file provided\n");
+    printf("Invalid --split-at distances: %s\n", splitAt.c_str());
     return 1;
   }
 
-  std::ifstream f(configFile);
-  if (!f.is_open())
+  if (seed < 0)
   {
-    printf("Could not open file: %s\n", configFile.c_str());
+    std::random_device rd;
+    seed = ((uint64_t(rd()) << 32) | rd()) >> 1;
+  }
+  args.seed = seed;
+
+  if (!shard.empty())
+  {
+    if (sscanf(shard.c_str(), "%u/%u", &args.shard, &args.shards) != 2 ||
+        args.shards == 0 || args.shard >= args.shards || args.shards > args.batches)
+    {
+      printf("Invalid --shard %s, expected i/N with i < N and N at most the number of batches\n", shard.c_str());
+      return 1;
+    }
+
+    if (!reportDirectory.empty() || !sweepFile.empty() || !searchFile.empty() || args.timeBudget > 0)
+    {
+      printf("--shard only works with --config and a fixed number of batches\n");
+      return 1;
+    }
+  }
+
+  args.confidence = confidence;
+
+  if (args.targetHalfWidth > 0 && (!reportDirectory.empty() || !sweepFile.empty() || !searchFile.empty() || args.shards > 1))
+  {
+    printf("--target-halfwidth only works with --config and without --shard\n");
     return 1;
   }
 
-  auto configs = json::parse(f);
-  bool running = true;
-  uint32_t iterations = args.iterations > 0 ? args.iterations : uint32_t(configs["iterations"]);
+  if (args.timeBudget > 0 && (!reportDirectory.empty() || !sweepFile.empty() || !searchFile.empty()))
+  {
+    printf("--time-budget only works with --config\n");
+    return 1;
+  }
 
-  if (!args.entity.empty() && !args.parameter.empty())
+  if (threads == 0)
   {
-    printf("Overwriting %s in %s to %.2f\n", args.parameter.c_str(), args.entity.c_str(), args.value);
-    try
+    printf("Invalid --threads 0, expected at least 1\n");
+    return 1;
+  }
+
+  if (threads > 0)
+    args.threads = uint32_t(threads);
+  else if (args.timeBudget > 0 && args.hidden)
+    args.threads = std::max(1u, std::thread::hardware_concurrency());
+
+  if (!replayFile.empty())
+    return PlayReplay(replayFile, replayIteration);
+
+  // Written a last time once main returns
+  std::unique_ptr<MetricsExporter> metrics;
+  if (!metricsFile.empty())
+  {
+    if (metricsInterval <= 0)
     {
-      if (args.entity == "guards")
-      {
-        if (args.parameter == "number_of_guards")
-        {
-          configs[args.entity][args.parameter] = args.value;
-        }
-        else
-        {
-          for (auto& c : configs[args.entity]["config"])
-            c[args.parameter] = args.value;
-        }
-      }
-      else
-      {
-        configs[args.entity][args.parameter] = args.value;
-      }
+      printf("Invalid --metrics-interval %g, expected a positive number of seconds\n", metricsInterval);
+      return 1;
     }
-    catch (const std::exception& e)
+
+    metrics = std::make_unique<MetricsExporter>(metricsFile, metricsInterval, confidence);
+    if (!metrics->Start())
+      return 1;
+  }
+
+  if (!recordDirectory.empty())
+  {
+    if (!reportDirectory.empty())
     {
-      printf("Error: %s\n", e.what());
-      return -1;
+      printf("--record only works with --config, --sweep and --search\n");
+      return 1;
     }
-  }
 
-  printf("Running game with config: %s\n", configFile.c_str());
-  printf("Test type: %s\n", std::string(configs["test_type"]).c_str());
-  printf("Observed value: %.6f\n", float(configs["observed_mean"]));
-  printf("Running %u batches and %u iterations\n", args.batches, iterations);
+    if (recordDirectory.back() != '/')
+      recordDirectory += "/";
+
+    if (!DoesFileExist(recordDirectory) && !CreateDirectory(recordDirectory))
+    {
+      printf("Failed to create directory: %s\n", recordDirectory.c_str());
+      return 1;
+    }
+
+    // Sweeps and searches add the name of every point
+    bool points = !sweepFile.empty() || !searchFile.empty();
+    args.record = recordDirectory + (points ? "" : GetFilename(configFile) + "_");
+  }
 
-  Statistics stats(configs["test_type"], args.batches, iterations);
+  if (!reportDirectory.empty())
+    return TimeStepReport(reportDirectory, args);
 
-  for (uint32_t i = 0; running && i < args.batches; ++i)
+  if (!sweepFile.empty() || !searchFile.empty())
   {
-    std::unique_ptr<Game> game = std::make_unique<Game>(configs);
-    if (!game->Init(args))
-      break;
+    if (!sweepFile.empty() && !searchFile.empty())
+    {
+      printf("--sweep and --search cannot be combined\n");
+      return 1;
+    }
+
+    if (!args.entity.empty() || !args.parameter.empty())
+    {
+      printf("--chg-* cannot be combined with --sweep or --search, add the parameter to the file instead\n");
+      return 1;
+    }
+
+    std::unique_ptr<ResultCache> cache;
+    if (!cacheDirectory.empty())
+    {
+      cache = std::make_unique<ResultCache>(cacheDirectory);
+      if (!cache->Init())
+        return 1;
+    }
 
-    stats.NewBatch();
-    for (uint32_t j = 0; running && j < iterations; ++j)
+    if (!searchFile.empty())
     {
-      running = game->Run();
-      stats.UpdateStats(j, game->GetResult());
-      game->Reset();
+      Search search;
+      if (!search.Init(searchFile))
+        return 1;
+
+      printf("Seed: %lu\n", args.seed);
+      return search.Run(args, confidence, outDirectory, cache.get()) ? 0 : 1;
     }
-    printf("Done with %u out of %u batches\n", i + 1, args.batches);
-    stats.Dump();
+
+    Sweep sweep;
+    if (!sweep.Init(sweepFile))
+      return 1;
+
+    printf("Seed: %lu\n", args.seed);
+    return sweep.Run(args, outDirectory, cache.get()) ? 0 : 1;
+  }
+
+  if (!cacheDirectory.empty())
+    printf("Ignoring --cache-dir, it is only used with --sweep and --search\n");
+
+  if (configFile.empty())
+  {
+    printf("No configuration file provided\n");
+    return 1;
+  }
+
+  // Parse the configuration only once, every batch and iteration reuses it
+  Blueprint blueprint;
+  if (!LoadBlueprint(configFile, args, blueprint))
+    return 1;
+
+  uint32_t iterations = args.iterations > 0 ? args.iterations : blueprint.iterations;
+
+  printf("Running game with config: %s\n", configFile.c_str());
+  printf("Test type: %s\n", blueprint.testType.c_str());
+  printf("Observed value: %.6f\n", blueprint.observedMean);
+  if (args.timeBudget > 0 && args.hidden)
+    printf("Running batches of %u iterations for %g seconds\n", iterations, args.timeBudget);
+  else
+    printf("Running %u batches and %u iterations\n", args.batches, iterations);
+  if (args.shards > 1)
+    printf("Shard %u of %u\n", args.shard, args.shards);
+  printf("Seed: %lu\n", args.seed);
+
+  // Runs of one batch save every iteration's sample, like they always have
+  if (args.batches == 1 && !(args.timeBudget > 0 && args.hidden))
+    args.keepSamples = true;
+
+  Statistics stats(blueprint.testType, blueprint.dayDuration, args.batches, iterations);
+  stats.KeepSamples(args.keepSamples);
+
+  if (args.targetHalfWidth > 0)
+  {
+    float z;
+    if (!stats.ZValue(confidence, z))
+      return 1;
+
+    // The interval comes from the batch method, which needs enough batches
+    bool budgeted = args.timeBudget > 0 && args.hidden;
+    if (!budgeted && args.batches <= MIN_SEQUENTIAL_BATCHES)
+      printf("Ignoring --target-halfwidth, it needs more than %u batches with -b\n", MIN_SEQUENTIAL_BATCHES);
+    else
+      printf("Stopping once the interval at %s is within +- %g, after at least %u batches\n", confidence.c_str(), args.targetHalfWidth, MIN_SEQUENTIAL_BATCHES);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  if (!RunBatches(blueprint, args, iterations, stats, true))
+    return 1;
+
+  if (stats.Batches() == 0)
+  {
+    printf("No batch finished within the time budget, try fewer iterations per batch\n");
+    return 1;
+  }
+
+  uint32_t first, end;
+  ShardBatches(args, first, end);
+  printf("Done running %u simulations\n", stats.Batches() * iterations);
+
+  if (args.targetHalfWidth > 0 && stats.Batches() > 1)
+  {
+    // The batch method needs to know how many batches the estimate has
+    stats.SetBatches(stats.Batches());
+
+    float halfWidth;
+    stats.HalfWidth(confidence, halfWidth);
+    const char* reached = IsPreciseEnough(args, stats) ? "reached" : "not reached";
+    printf("Target half width %g %s after %u batches: %.6f +- %.6f\n", args.targetHalfWidth, reached, stats.Batches(), stats.GetStats().mean, halfWidth);
   }
 
-  printf("Done running %u simulations\n", args.batches * iterations);
+  if (args.timeBudget > 0 && args.hidden)
+  {
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    printf("Simulated %.1f iterations per second\n", stats.Batches() * iterations / seconds);
+
+    float halfWidth;
+    if (stats.HalfWidth(confidence, halfWidth))
+      printf("Confidence interval at %s: %.6f +- %.6f (width %.6f)\n", confidence.c_str(), stats.GetStats().mean, halfWidth, 2 * halfWidth);
+  }
 
   std::string fileWithoutExtension = GetFilename(configFile) + "_" + (args.value == FLT_MAX ? GetDate() : std::to_string(int(args.value)));
+
+  if (args.shards > 1)
+  {
+    // Everything the merge needs to check that the shards belong together
+    json header;
+    header["name"] = fileWithoutExtension;
+    header["level"] = blueprint.level;
+    header["test_type"] = blueprint.testType;
+    header["observed_mean"] = blueprint.observedMean;
+    header["day_length"] = blueprint.dayDuration;
+    header["batches"] = args.batches;
+    header["iterations"] = iterations;
+    header["seed"] = args.seed;
+    header["time_step"] = args.timeStep;
+    header["replicas"] = args.replicas;
+    header["common_random"] = args.commonRandom;
+    header["antithetic"] = args.antithetic;
+    header["split_at"] = args.splitLevels;
+    header["split_factor"] = args.splitFactor;
+    header["chg_entity"] = args.entity;
+    header["chg_param"] = args.parameter;
+    header["chg_value"] = args.value;
+    header["shard"] = args.shard;
+    header["shards"] = args.shards;
+
+    std::string partialFile = outDirectory + fileWithoutExtension + "_shard_" + std::to_string(args.shard) + "_of_" + std::to_string(args.shards) + ".json";
+    if (!stats.SavePartial(partialFile, header))
+      return 1;
+
+    printf("Saved batches %u to %u into %s\n", first, end - 1, partialFile.c_str());
+    return 0;
+  }
   stats.Save(outDirectory + fileWithoutExtension + ".txt");
 
-  observed = observed < 0.0 ? float(configs["observed_mean"]) : observed;
+  Statistics::PairedStats antithetic;
+  if (args.antithetic && stats.PairIterations(antithetic))
+    printf("Antithetic pairs: %lu, variance reduction of the pair means %.2fx\n", antithetic.count, antithetic.reduction);
+
+  observed = observed < 0.0 ? blueprint.observedMean : observed;
   stats.ZTest(confidence, observed);
 
   return 0;
@@ -0,0 +1,208 @@
+#include "metrics.h"
+
+#include <stdio.h>
+#include <atomic>
+
+#include "helpers.h"
+
+static std::atomic<bool> enabled(false);
+
+static std::atomic<uint64_t> ticks(0);
+static std::atomic<uint64_t> iterations(0);
+static std::atomic<uint64_t> nanoseconds[SUBSYSTEMS];
+
+static const char* SUBSYSTEM_NAMES[SUBSYSTEMS] = { "crowd", "doors", "attacker", "recording" };
+
+// Written by whichever thread merges batches, read by the exporter
+static std::mutex estimateMutex;
+static std::string confidence;
+static struct
+{
+  bool valid = false;
+  uint32_t batches = 0;
+  float mean = 0.0;
+  float variance = 0.0;
+  bool hasHalfWidth = false;
+  float halfWidth = 0.0;
+} estimate;
+
+bool MetricsEnabled()
+{
+  return enabled;
+}
+
+void ReportMetrics(const RunMetrics& metrics)
+{
+  ticks += metrics.ticks;
+  iterations += metrics.iterations;
+  for (uint32_t i = 0; i < SUBSYSTEMS; ++i)
+    nanoseconds[i] += metrics.nanoseconds[i];
+}
+
+void ReportEstimate(const Statistics& stats)
+{
+  if (!enabled || stats.Batches() == 0)
+    return;
+
+  Statistics::TestStats full = stats.GetStats();
+
+  std::lock_guard<std::mutex> lock(estimateMutex);
+  estimate.valid = true;
+  estimate.batches = stats.Batches();
+  estimate.mean = full.mean;
+  estimate.variance = full.variance;
+  estimate.hasHalfWidth = stats.HalfWidth(confidence, estimate.halfWidth);
+}
+
+MetricsExporter::MetricsExporter(const std::string& filename, float interval, const std::string& confidenceLevel)
+    : mFilename(filename)
+    , mInterval(interval)
+    , mStop(false)
+    , mLastTicks(0)
+    , mLastIterations(0)
+{
+  std::lock_guard<std::mutex> lock(estimateMutex);
+  confidence = confidenceLevel;
+}
+
+MetricsExporter::~MetricsExporter()
+{
+  if (!mThread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mWake.notify_one();
+  mThread.join();
+
+  enabled = false;
+}
+
+bool MetricsExporter::Start()
+{
+  std::string dir = RemoveFilename(mFilename);
+  if (!dir.empty() && !DoesFileExist(dir) && !CreateDirectory(dir))
+  {
+    printf("Failed to create directory: %s\n", dir.c_str());
+    return false;
+  }
+
+  mStart = std::chrono::steady_clock::now();
+  mLastWrite = mStart;
+
+  // Fail early on a path that cannot be written
+  RETURN_ON_FAILURE(Write());
+
+  enabled = true;
+  mThread = std::thread([this]{ Work(); });
+  return true;
+}
+
+void MetricsExporter::Work()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (!mStop)
+  {
+    mWake.wait_for(lock, mInterval);
+
+    // A failed write is retried with the next one, the run goes on
+    Write();
+  }
+}
+
+bool MetricsExporter::Write()
+{
+  auto now = std::chrono::steady_clock::now();
+  float elapsed = std::chrono::duration<float>(now - mStart).count();
+  float sinceLast = std::chrono::duration<float>(now - mLastWrite).count();
+
+  uint64_t totalTicks = ticks;
+  uint64_t totalIterations = iterations;
+
+  uint64_t measured = 0;
+  uint64_t times[SUBSYSTEMS];
+  for (uint32_t i = 0; i < SUBSYSTEMS; ++i)
+  {
+    times[i] = nanoseconds[i];
+    measured += times[i];
+  }
+
+  // Written next to the file and renamed, so a scrape never reads half of it
+  std::string tempFile = mFilename + ".tmp";
+  FILE* file = fopen(tempFile.c_str(), "w");
+  if (!file)
+  {
+    printf("Could not open metrics file: %s\n", tempFile.c_str());
+    return false;
+  }
+
+  fprintf(file, "# HELP intrusion_elapsed_seconds Wall time since the run started.\n");
+  fprintf(file, "# TYPE intrusion_elapsed_seconds gauge\n");
+  fprintf(file, "intrusion_elapsed_seconds %.3f\n", elapsed);
+
+  fprintf(file, "# HELP intrusion_ticks_total Ticks simulated by all iterations, one per second of day time.\n");
+  fprintf(file, "# TYPE intrusion_ticks_total counter\n");
+  fprintf(file, "intrusion_ticks_total %lu\n", totalTicks);
+
+  fprintf(file, "# HELP intrusion_ticks_per_second Ticks simulated per second of wall time since the last write.\n");
+  fprintf(file, "# TYPE intrusion_ticks_per_second gauge\n");
+  fprintf(file, "intrusion_ticks_per_second %.1f\n", sinceLast > 0 ? (totalTicks - mLastTicks) / sinceLast : 0.0);
+
+  fprintf(file, "# HELP intrusion_iterations_total Iterations completed.\n");
+  fprintf(file, "# TYPE intrusion_iterations_total counter\n");
+  fprintf(file, "intrusion_iterations_total %lu\n", totalIterations);
+
+  fprintf(file, "# HELP intrusion_iterations_per_second Iterations completed per second of wall time since the last write.\n");
+  fprintf(file, "# TYPE intrusion_iterations_per_second gauge\n");
+  fprintf(file, "intrusion_iterations_per_second %.3f\n", sinceLast > 0 ? (totalIterations - mLastIterations) / sinceLast : 0.0);
+
+  // Sampled ticks stand for the ones around them
+  fprintf(file, "# HELP intrusion_tick_seconds_total Estimated time spent in each subsystem of the ticks.\n");
+  fprintf(file, "# TYPE intrusion_tick_seconds_total counter\n");
+  for (uint32_t i = 0; i < SUBSYSTEMS; ++i)
+    fprintf(file, "intrusion_tick_seconds_total{subsystem=\"%s\"} %.6f\n", SUBSYSTEM_NAMES[i], times[i] * 1e-9 * METRICS_SAMPLING);
+
+  fprintf(file, "# HELP intrusion_tick_share Share of the tick time spent in each subsystem.\n");
+  fprintf(file, "# TYPE intrusion_tick_share gauge\n");
+  for (uint32_t i = 0; i < SUBSYSTEMS; ++i)
+    fprintf(file, "intrusion_tick_share{subsystem=\"%s\"} %.4f\n", SUBSYSTEM_NAMES[i], measured > 0 ? double(times[i]) / measured : 0.0);
+
+  {
+    std::lock_guard<std::mutex> lock(estimateMutex);
+    if (estimate.valid)
+    {
+      fprintf(file, "# HELP intrusion_batches Batches in the current estimate.\n");
+      fprintf(file, "# TYPE intrusion_batches gauge\n");
+      fprintf(file, "intrusion_batches %u\n", estimate.batches);
+
+      fprintf(file, "# HELP intrusion_estimate_mean Running mean of the test statistic.\n");
+      fprintf(file, "# TYPE intrusion_estimate_mean gauge\n");
+      fprintf(file, "intrusion_estimate_mean %.6f\n", estimate.mean);
+
+      fprintf(file, "# HELP intrusion_estimate_variance Running variance of the test statistic.\n");
+      fprintf(file, "# TYPE intrusion_estimate_variance gauge\n");
+      fprintf(file, "intrusion_estimate_variance %.6f\n", estimate.variance);
+    }
+
+    if (estimate.valid && estimate.hasHalfWidth)
+    {
+      fprintf(file, "# HELP intrusion_confidence_width Width of the confidence interval of the mean.\n");
+      fprintf(file, "# TYPE intrusion_confidence_width gauge\n");
+      fprintf(file, "intrusion_confidence_width{confidence=\"%s\"} %.6f\n", confidence.c_str(), 2 * estimate.halfWidth);
+    }
+  }
+
+  bool written = fclose(file) == 0;
+  if (!written || rename(tempFile.c_str(), mFilename.c_str()) != 0)
+  {
+    printf("Failed to write metrics file: %s\n", mFilename.c_str());
+    return false;
+  }
+
+  mLastWrite = now;
+  mLastTicks = totalTicks;
+  mLastIterations = totalIterations;
+  return true;
+}
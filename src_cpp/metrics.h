@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "statistics.h"
+
+// Live counters of a run, which MetricsExporter writes in the Prometheus
+// text format so long runs can be watched while they go. Every simulation
+// of the process adds to the same counters, but only while an exporter is
+// running, so runs without --metrics do not pay for them.
+
+// Parts of a tick whose time is measured
+enum Subsystem : uint32_t
+{
+  SUBSYSTEM_CROWD,      // Guards and employees
+  SUBSYSTEM_DOORS,
+  SUBSYSTEM_ATTACKER,
+  SUBSYSTEM_RECORDING,
+  SUBSYSTEMS
+};
+
+// Only one tick in this many is split into subsystems, which is plenty for
+// their shares and keeps the clock out of all other ticks
+static const uint32_t METRICS_SAMPLING = 64;
+
+// Work of one simulation since it last reported
+struct RunMetrics
+{
+  uint64_t ticks = 0;
+  uint64_t iterations = 0;
+  uint64_t nanoseconds[SUBSYSTEMS] = {};  // Of the sampled ticks only
+};
+
+// True while an exporter is running
+bool MetricsEnabled();
+
+// Add to the counters of the process, safe to call from any thread
+void ReportMetrics(const RunMetrics& metrics);
+
+// Latest estimate of a run, with the confidence interval at the
+// confidence of the exporter
+void ReportEstimate(const Statistics& stats);
+
+class MetricsExporter
+{
+public:
+  // Write the metrics to filename every interval seconds
+  MetricsExporter(const std::string& filename, float interval, const std::string& confidence);
+
+  // Writes the file one last time
+  ~MetricsExporter();
+
+  bool Start();
+
+private:
+  std::string mFilename;
+  std::chrono::duration<float> mInterval;
+
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  bool mStop;
+
+  // When the file was last written and what the counters were then
+  std::chrono::steady_clock::time_point mStart;
+  std::chrono::steady_clock::time_point mLastWrite;
+  uint64_t mLastTicks;
+  uint64_t mLastIterations;
+
+  void Work();
+  bool Write();
+};
@@ -4,23 +4,28 @@
 
 #include "helpers.h"
 
-Movable::Movable(int x, int y, const std::vector<Line> walls, SDL_Renderer* renderer)
-    : mRenderer(renderer)
-    , mWalls(walls)
+Movable::Movable(int x, int y, const NavGrid& nav, const Settings& settings)
+    : mNav(nav)
+    , mSettings(settings)
     , mIsChecking(-1)
     , mState(State::IDLE)
     , mSpeed(0)
+    , mPresent(true)
+    , mPathsFound(0)
 {
 
   mPos.x = x;
   mPos.y = y;
 
   mRandom = std::make_unique<Randomizer>(-1, 1);
-  mRandomWidth = std::make_unique<Randomizer>(1, WIDTH - 1);
-  mRandomHeight = std::make_unique<Randomizer>(1, HEIGHT - 1);
+  mRandomWidth = std::make_unique<Randomizer>(1, mSettings.width - 1);
+  mRandomHeight = std::make_unique<Randomizer>(1, mSettings.height - 1);
 
   mDir.x = mRandom->Uniform();
   mDir.y = mRandom->Uniform();
+
+  // Found paths replace each other in place during ticks
+  mPoints.reserve(MAX_PATH_POINTS);
 }
 
 Movable::~Movable()
@@ -55,23 +60,93 @@ void Movable::StopCheck(int id)
     mIsChecking = -1;
 }
 
+void Movable::Reset()
+{
+  mIsChecking = -1;
+  mState = State::IDLE;
+  mPoints.clear();
+  mPresent = true;
+
+  mDir.x = mRandom->Uniform();
+  mDir.y = mRandom->Uniform();
+}
+
+void Movable::Save(Snapshot& snapshot) const
+{
+  snapshot.pos = mPos;
+  snapshot.dir = mDir;
+  snapshot.speed = mSpeed;
+  snapshot.state = int(mState);
+  snapshot.isChecking = mIsChecking;
+  snapshot.present = mPresent;
+  snapshot.points = mPoints;
+
+  snapshot.random = mRandom->Save();
+  snapshot.randomWidth = mRandomWidth->Save();
+  snapshot.randomHeight = mRandomHeight->Save();
+}
+
+void Movable::Restore(const Snapshot& snapshot)
+{
+  mPos = snapshot.pos;
+  mDir = snapshot.dir;
+  mSpeed = snapshot.speed;
+  mState = State(snapshot.state);
+  mIsChecking = snapshot.isChecking;
+  mPresent = snapshot.present;
+  mPoints = snapshot.points;
+
+  mRandom->Restore(snapshot.random);
+  mRandomWidth->Restore(snapshot.randomWidth);
+  mRandomHeight->Restore(snapshot.randomHeight);
+}
+
+void Movable::Reseed(uint64_t key, bool mirrored)
+{
+  mRandom->Seed(Randomizer::Key(key, 0), mirrored);
+  mRandomWidth->Seed(Randomizer::Key(key, 1), mirrored);
+  mRandomHeight->Seed(Randomizer::Key(key, 2), mirrored);
+}
+
+bool Movable::IsPresent() const
+{
+  return mPresent;
+}
+
+uint32_t Movable::PathsFound() const
+{
+  return mPathsFound;
+}
+
 bool Movable::IsChecking() const
 {
   return mIsChecking != -1;
 }
 
+Color Movable::GetColor() const
+{
+  return mColor;
+}
+
+const std::vector<Point>& Movable::Path() const
+{
+  return mPoints;
+}
+
 void Movable::Constrain(float speed)
 {
   // Ensure objects dont leave the scene
-  if (floor(X()) + HALF_TILE > WIDTH)
-    mPos.x = WIDTH - HALF_TILE;
-  else if (floor(X()) - HALF_TILE < 0)
-    mPos.x = HALF_TILE;
+  const uint32_t halfTile = mSettings.halfTile;
 
-  if (floor(Y()) + HALF_TILE> HEIGHT)
-    mPos.y = HEIGHT - HALF_TILE;
-  else if (floor(Y()) - HALF_TILE < 0)
-    mPos.y = HALF_TILE;
+  if (floor(X()) + halfTile > mSettings.width)
+    mPos.x = mSettings.width - halfTile;
+  else if (floor(X()) - halfTile < 0)
+    mPos.x = halfTile;
+
+  if (floor(Y()) + halfTile> mSettings.height)
+    mPos.y = mSettings.height - halfTile;
+  else if (floor(Y()) - halfTile < 0)
+    mPos.y = halfTile;
 }
 
 void Movable::Move(const Point& goal)
@@ -84,20 +159,22 @@ void Movable::Move(const Point& goal)
 
   if (mPoints.empty())
   {
-    if (ToWorld(goal) != ToWorld(mPos))
-      mPoints = PathFinding(mPos, goal, mWalls);
+    if (ToWorld(goal, mSettings.tileSize) != ToWorld(mPos, mSettings.tileSize))
+      PathFinding(mPos, goal, mNav, mPoints);
+
+    if (!mPoints.empty())
+      ++mPathsFound;
   }
   else
   {
-    int index = 0;
-    if (mPoints.size() > mSpeed)
-      index = mSpeed;
+    // Cover the distance of every tick in the step at once
+    uint32_t index = 0;
+    uint32_t steps = (mSpeed + 1) * mSettings.timeStep - 1;
+    if (mPoints.size() > steps)
+      index = steps;
 
     mPos = *(mPoints.begin() + index);
 
-    if (!HIDDEN)
-      DrawPoints();
-
     mPoints.erase(mPoints.begin(), mPoints.begin() + index + 1);
 
     // Only allow other behaviours once entity is in position
@@ -109,16 +186,6 @@ void Movable::Move(const Point& goal)
 void Movable::Update()
 {
   Move(GetRandomPoint());
-
-  if (HIDDEN)
-    return;
-
-  if (IsChecking())
-    SDL_SetRenderDrawColor(mRenderer, 255, 127, 80, 255);
-  else
-    SDL_SetRenderDrawColor(mRenderer, mColor.r, mColor.g, mColor.b, 255);
-
-  DrawCircle(mPos.x, mPos.y, 8);
 }
 
 Point Movable::GetRandomPoint() const
@@ -131,13 +198,7 @@ Point Movable::GetRandomPoint() const
     ok = true;
     pos.x = mRandomWidth->Uniform();
     pos.y = mRandomHeight->Uniform();
-    for (const auto& wall : mWalls)
-    {
-      SDL_Rect d = wall.deadzone;
-      if (pos.x >= d.x && pos.x <= d.x + d.w &&
-          pos.y >= d.y && pos.y <= d.y + d.h)
-        ok = false;
-    }
+    ok = mNav.IsFree(pos);
   } while (!ok);
 
   return pos;
@@ -149,54 +210,3 @@ void Movable::SetColor(uint8_t r, uint8_t g, uint8_t b)
   mColor.g = g;
   mColor.b = b;
 }
-
-void Movable::DrawPoints()
-{
-  SDL_SetRenderDrawColor(mRenderer, mColor.r, mColor.g, mColor.b, 255);
-
-  for (int i = 1; i < mPoints.size(); ++i)
-  {
-    auto p1 = mPoints.at(i - 1);
-    auto p2 = mPoints.at(i);
-    DrawCircle(p1.x, p1.y, 3);
-    SDL_RenderDrawLine(mRenderer, p1.x, p1.y, p2.x, p2.y);
-  }
-}
-
-void Movable::DrawCircle(int32_t centreX, int32_t centreY, int32_t radius)
-{
-   const int32_t diameter = (radius * 2);
-
-   int32_t x = (radius - 1);
-   int32_t y = 0;
-   int32_t tx = 1;
-   int32_t ty = 1;
-   int32_t error = (tx - diameter);
-
-   while (x >= y)
-   {
-      //  Each of the following renders an octant of the circle
-      SDL_RenderDrawPoint(mRenderer, centreX + x, centreY - y);
-      SDL_RenderDrawPoint(mRenderer, centreX + x, centreY + y);
-      SDL_RenderDrawPoint(mRenderer, centreX - x, centreY - y);
-      SDL_RenderDrawPoint(mRenderer, centreX - x, centreY + y);
-      SDL_RenderDrawPoint(mRenderer, centreX + y, centreY - x);
-      SDL_RenderDrawPoint(mRenderer, centreX + y, centreY + x);
-      SDL_RenderDrawPoint(mRenderer, centreX - y, centreY - x);
-      SDL_RenderDrawPoint(mRenderer, centreX - y, centreY + x);
-
-      if (error <= 0)
-      {
-         ++y;
-         error += ty;
-         ty += 2;
-      }
-
-      if (error > 0)
-      {
-         --x;
-         tx += 2;
-         error += (tx - diameter);
-      }
-   }
-}
\ No newline at end of file
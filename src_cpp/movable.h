@@ -4,18 +4,18 @@
 #include <memory>
 #include <vector>
 
-#include <SDL2/SDL.h>
-
+#include "navigation.h"
 #include "randomizer.h"
 #include "settings.h"
 
 class Movable
 {
 public:
-  Movable(int x, int y, const std::vector<Line> walls, SDL_Renderer* renderer);
+  Movable(int x, int y, const NavGrid& nav, const Settings& settings);
   ~Movable();
 
   virtual void Update();
+  virtual void Reset();
 
   float X() const;
   float Y() const;
@@ -26,6 +26,39 @@ public:
 
   bool IsChecking() const;
 
+  Color GetColor() const;
+
+  // Remaining points of the path being walked
+  const std::vector<Point>& Path() const;
+
+  // False while the entity is somewhere else, e.g. on another floor
+  bool IsPresent() const;
+
+  // Number of paths found so far, which tells observers like the replay
+  // recorder that Path() was replaced rather than walked along
+  uint32_t PathsFound() const;
+
+  struct Snapshot
+  {
+    Point pos;
+    Point dir;
+    int speed = 0;
+    int state = 0;
+    int isChecking = -1;
+    bool present = true;
+    std::vector<Point> points;
+
+    Randomizer::State random;
+    Randomizer::State randomWidth;
+    Randomizer::State randomHeight;
+  };
+
+  void Save(Snapshot& snapshot) const;
+  void Restore(const Snapshot& snapshot);
+
+  // Derive every random sequence from key, see Randomizer::Key
+  virtual void Reseed(uint64_t key, bool mirrored);
+
 protected:
   Point mPos;
   Point mDir;
@@ -39,8 +72,8 @@ protected:
 
   Color mColor;
 
-  SDL_Renderer* mRenderer;
-  std::vector<Line> mWalls;
+  const NavGrid& mNav;
+  const Settings& mSettings;
 
   std::unique_ptr<Randomizer> mRandom;
   std::unique_ptr<Randomizer> mRandomWidth;
@@ -48,14 +81,15 @@ protected:
 
   std::vector<Point> mPoints;
 
+  bool mPresent;
+  uint32_t mPathsFound;
+
   Point GetRandomPoint() const;
 
   virtual void Move(const Point& goal);
   virtual void Constrain(float speed);
 
   void SetColor(uint8_t r, uint8_t g, uint8_t b);
-  void DrawCircle(int centreX, int centreY, int radius);
-  void DrawPoints();
 
 private:
   int mIsChecking;
@@ -0,0 +1,304 @@
+#include "navigation.h"
+
+#include <cmath>
+
+#include "helpers.h"
+
+// Bit used in the passability mask for every neighbour direction
+static int StepBit(int dx, int dy)
+{
+  int k = (dx + 1) * 3 + (dy + 1);
+  return k < 4 ? k : k - 1;
+}
+
+NavGrid::NavGrid()
+    : mTileSize(1)
+    , mWidth(0)
+    , mHeight(0)
+    , mColumns(0)
+    , mRows(0)
+    , mTileColumns(0)
+    , mTileRows(0)
+    , mPassable(nullptr)
+    , mFreeTiles(nullptr)
+    , mVisible(nullptr)
+{
+}
+
+NavGrid::~NavGrid()
+{
+}
+
+void NavGrid::SetDimensions(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls)
+{
+  mWidth = width;
+  mHeight = height;
+  mTileSize = tileSize;
+  mWalls = walls;
+
+  mColumns = width / tileSize + 1;
+  mRows = height / tileSize + 1;
+
+  mTileColumns = (width + tileSize - 1) / tileSize;
+  mTileRows = (height + tileSize - 1) / tileSize;
+
+  // Walls without a dead zone have an empty one, which can never be sampled
+  mDeadzones.clear();
+  for (const auto& wall : walls)
+  {
+    if (wall.deadzone.w != 0 || wall.deadzone.h != 0)
+      mDeadzones.push_back(wall.deadzone);
+  }
+}
+
+bool NavGrid::Matches(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls) const
+{
+  if (width != mWidth || height != mHeight || tileSize != mTileSize || walls.size() != mWalls.size())
+    return false;
+
+  for (uint32_t i = 0; i < walls.size(); ++i)
+  {
+    const Line& a = walls[i];
+    const Line& b = mWalls[i];
+    if (a.p1.x != b.p1.x || a.p1.y != b.p1.y || a.p2.x != b.p2.x || a.p2.y != b.p2.y ||
+        a.deadzone.x != b.deadzone.x || a.deadzone.y != b.deadzone.y ||
+        a.deadzone.w != b.deadzone.w || a.deadzone.h != b.deadzone.h)
+      return false;
+  }
+
+  return true;
+}
+
+bool NavGrid::Build(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls)
+{
+  if (tileSize == 0)
+    return false;
+
+  SetDimensions(width, height, tileSize, walls);
+
+  // Passability of every node towards its eight neighbours
+  mPassableStorage.assign(Nodes(), 0);
+  for (int x = 0; x < int(mColumns); ++x)
+  {
+    for (int y = 0; y < int(mRows); ++y)
+    {
+      Point from = Centre(x, y);
+      for (int i = -1; i <= 1; ++i)
+      {
+        for (int j = -1; j <= 1; ++j)
+        {
+          if (i == 0 && j == 0)
+            continue;
+
+          if (x + i < 0 || x + i >= int(mColumns) || y + j < 0 || y + j >= int(mRows))
+            continue;
+
+          Point to = Centre(x + i, y + j);
+          if (Raycast(from, to, mWalls) == to)
+            mPassableStorage[x * mRows + y] |= 1 << StepBit(i, j);
+        }
+      }
+    }
+  }
+
+  // Classify tiles so random positions only test dead zones near their borders
+  mFreeTileStorage.assign(Tiles(), TILE_FREE);
+  for (uint32_t x = 0; x < mTileColumns; ++x)
+  {
+    for (uint32_t y = 0; y < mTileRows; ++y)
+    {
+      float x1 = x * tileSize;
+      float y1 = y * tileSize;
+      float x2 = x1 + tileSize;
+      float y2 = y1 + tileSize;
+
+      uint8_t state = TILE_FREE;
+      for (const auto& d : mDeadzones)
+      {
+        if (d.x > x2 || d.x + d.w < x1 || d.y > y2 || d.y + d.h < y1)
+          continue;
+
+        if (d.x <= x1 && d.x + d.w >= x2 && d.y <= y1 && d.y + d.h >= y2)
+        {
+          state = TILE_BLOCKED;
+          break;
+        }
+
+        state = TILE_PARTIAL;
+      }
+
+      mFreeTileStorage[x * mTileRows + y] = state;
+    }
+  }
+
+  // Line of sight between every pair of node centres
+  mVisibleStorage.clear();
+  if (Nodes() <= MAX_VISIBILITY_NODES)
+  {
+    mVisibleStorage.assign(VisibilityWords(), 0);
+    for (uint32_t a = 0; a < Nodes(); ++a)
+    {
+      Point from = Centre(a / mRows, a % mRows);
+      for (uint32_t b = 0; b < Nodes(); ++b)
+      {
+        Point to = Centre(b / mRows, b % mRows);
+        if (Raycast(from, to, mWalls) == to)
+        {
+          uint64_t bit = uint64_t(a) * Nodes() + b;
+          mVisibleStorage[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+      }
+    }
+  }
+
+  mPassable = mPassableStorage.data();
+  mFreeTiles = mFreeTileStorage.data();
+  mVisible = mVisibleStorage.empty() ? nullptr : mVisibleStorage.data();
+  mBacking = nullptr;
+
+  return true;
+}
+
+bool NavGrid::Attach(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls,
+                     const uint8_t* passable, const uint8_t* freeTiles, const uint64_t* visible,
+                     std::shared_ptr<const void> backing)
+{
+  if (tileSize == 0 || !passable || !freeTiles)
+    return false;
+
+  SetDimensions(width, height, tileSize, walls);
+
+  mPassableStorage.clear();
+  mFreeTileStorage.clear();
+  mVisibleStorage.clear();
+
+  mPassable = passable;
+  mFreeTiles = freeTiles;
+  mVisible = visible;
+  mBacking = backing;
+
+  return true;
+}
+
+bool NavGrid::CanStep(int x, int y, int dx, int dy) const
+{
+  if (x < 0 || x >= int(mColumns) || y < 0 || y >= int(mRows))
+    return false;
+
+  return mPassable[x * mRows + y] & (1 << StepBit(dx, dy));
+}
+
+bool NavGrid::IsVisible(const Point& from, const Point& to) const
+{
+  int a = Node(from);
+  int b = Node(to);
+
+  // Entities which have not walked yet are not on node centres
+  if (!mVisible || a < 0 || b < 0)
+    return Raycast(from, to, mWalls) == to;
+
+  uint64_t bit = uint64_t(a) * Nodes() + b;
+  return mVisible[bit / 64] & (uint64_t(1) << (bit % 64));
+}
+
+bool NavGrid::IsFree(const Point& p) const
+{
+  int x = std::floor(p.x / mTileSize);
+  int y = std::floor(p.y / mTileSize);
+
+  if (x < 0 || x >= int(mTileColumns) || y < 0 || y >= int(mTileRows))
+    return !InDeadzone(p);
+
+  switch (mFreeTiles[x * mTileRows + y])
+  {
+    case TILE_FREE:
+      return true;
+    case TILE_BLOCKED:
+      return false;
+    default:
+      return !InDeadzone(p);
+  }
+}
+
+bool NavGrid::InDeadzone(const Point& p) const
+{
+  for (const auto& d : mDeadzones)
+  {
+    if (p.x >= d.x && p.x <= d.x + d.w &&
+        p.y >= d.y && p.y <= d.y + d.h)
+      return true;
+  }
+
+  return false;
+}
+
+const std::vector<Line>& NavGrid::Walls() const
+{
+  return mWalls;
+}
+
+uint32_t NavGrid::Width() const
+{
+  return mWidth;
+}
+
+uint32_t NavGrid::Height() const
+{
+  return mHeight;
+}
+
+uint32_t NavGrid::TileSize() const
+{
+  return mTileSize;
+}
+
+uint32_t NavGrid::Nodes() const
+{
+  return mColumns * mRows;
+}
+
+uint32_t NavGrid::Tiles() const
+{
+  return mTileColumns * mTileRows;
+}
+
+uint32_t NavGrid::VisibilityWords() const
+{
+  return Nodes() <= MAX_VISIBILITY_NODES ? (uint64_t(Nodes()) * Nodes() + 63) / 64 : 0;
+}
+
+const uint8_t* NavGrid::PassableData() const
+{
+  return mPassable;
+}
+
+const uint8_t* NavGrid::FreeTileData() const
+{
+  return mFreeTiles;
+}
+
+const uint64_t* NavGrid::VisibleData() const
+{
+  return mVisible;
+}
+
+int NavGrid::Node(const Point& p) const
+{
+  int x = std::floor(p.x / mTileSize);
+  int y = std::floor(p.y / mTileSize);
+
+  if (x < 0 || x >= int(mColumns) || y < 0 || y >= int(mRows))
+    return -1;
+
+  Point centre = Centre(x, y);
+  if (centre.x != p.x || centre.y != p.y)
+    return -1;
+
+  return x * mRows + y;
+}
+
+Point NavGrid::Centre(int x, int y) const
+{
+  uint32_t halfTile = mTileSize / 2;
+  return Point(x * mTileSize + halfTile - 1, y * mTileSize + halfTile - 1);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "settings.h"
+
+// Static navigation data derived from the walls of a level.
+// Everything here only depends on the level geometry, so it is computed once
+// per blueprint (or loaded from a compiled level file) and shared read-only by
+// every entity of every iteration.
+class NavGrid
+{
+public:
+  NavGrid();
+  ~NavGrid();
+
+  bool Build(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls);
+
+  // Use tables stored elsewhere (e.g. a mapped level file). The backing
+  // object is kept alive for as long as this grid exists.
+  bool Attach(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls,
+              const uint8_t* passable, const uint8_t* freeTiles, const uint64_t* visible,
+              std::shared_ptr<const void> backing);
+
+  // True if a mover can go from node (x, y) to node (x + dx, y + dy) without crossing a wall
+  bool CanStep(int x, int y, int dx, int dy) const;
+
+  // Same result as comparing Raycast(from, to, walls) against to
+  bool IsVisible(const Point& from, const Point& to) const;
+
+  // False if the point lies inside one of the walls' dead zones
+  bool IsFree(const Point& p) const;
+
+  const std::vector<Line>& Walls() const;
+
+  // True if Build with these arguments would give this grid again
+  bool Matches(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls) const;
+
+  // Level dimensions in pixels
+  uint32_t Width() const;
+  uint32_t Height() const;
+  uint32_t TileSize() const;
+
+  uint32_t Nodes() const;
+  uint32_t Tiles() const;
+  uint32_t VisibilityWords() const;
+
+  const uint8_t* PassableData() const;
+  const uint8_t* FreeTileData() const;
+  const uint64_t* VisibleData() const;
+
+  enum TileState : uint8_t
+  {
+    TILE_FREE = 0,
+    TILE_BLOCKED,
+    TILE_PARTIAL
+  };
+
+  // Above this many nodes the visibility table is not worth its memory
+  static const uint32_t MAX_VISIBILITY_NODES = 4096;
+
+private:
+  uint32_t mTileSize;
+  uint32_t mWidth;
+  uint32_t mHeight;
+
+  // Path finding nodes, including the ones on the right and bottom borders
+  uint32_t mColumns;
+  uint32_t mRows;
+
+  // Tiles used to accelerate dead zone lookups
+  uint32_t mTileColumns;
+  uint32_t mTileRows;
+
+  std::vector<Line> mWalls;
+  std::vector<Rect> mDeadzones;
+
+  const uint8_t* mPassable;
+  const uint8_t* mFreeTiles;
+  const uint64_t* mVisible;
+
+  std::vector<uint8_t> mPassableStorage;
+  std::vector<uint8_t> mFreeTileStorage;
+  std::vector<uint64_t> mVisibleStorage;
+  std::shared_ptr<const void> mBacking;
+
+  void SetDimensions(uint32_t width, uint32_t height, uint32_t tileSize, const std::vector<Line>& walls);
+
+  int Node(const Point& p) const;
+  Point Centre(int x, int y) const;
+  bool InDeadzone(const Point& p) const;
+};
+
+typedef std::shared_ptr<const NavGrid> PNavGrid;
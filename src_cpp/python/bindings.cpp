@@ -0,0 +1,252 @@
+// Python module around the simulation core, built with -DBUILD_PYTHON=ON:
+//
+//   import intrusion
+//   level = intrusion.Level("../levels/verified/level_2_p.json")
+//   result = level.run(iterations=100, batches=10, seed=42, threads=4,
+//                      overrides={"guards/number_of_guards": 3})
+//   result.mean, result.variance, result.samples  # samples is a numpy array
+//
+// The level is parsed once per Level and levels with the same walls share
+// their navigation data. Result arrays are views of the C++ buffers, which
+// live as long as the result object they came from.
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "batch_runner.h"
+#include "blueprint.h"
+#include "level_file.h"
+#include "statistics.h"
+#include "sweep.h"
+
+namespace py = pybind11;
+using json = nlohmann::json;
+
+static json ToJson(const py::handle& value)
+{
+  // bool first, Python considers it an int
+  if (py::isinstance<py::bool_>(value))
+    return value.cast<bool>();
+
+  if (py::isinstance<py::int_>(value))
+    return value.cast<int64_t>();
+
+  if (py::isinstance<py::float_>(value))
+    return value.cast<double>();
+
+  if (py::isinstance<py::str>(value))
+    return value.cast<std::string>();
+
+  if (py::isinstance<py::list>(value) || py::isinstance<py::tuple>(value))
+  {
+    json array = json::array();
+    for (const auto& item : value)
+      array.push_back(ToJson(item));
+
+    return array;
+  }
+
+  if (py::isinstance<py::dict>(value))
+  {
+    json object = json::object();
+    for (const auto& item : value.cast<py::dict>())
+      object[item.first.cast<std::string>()] = ToJson(item.second);
+
+    return object;
+  }
+
+  // NumPy scalars
+  if (py::hasattr(value, "__index__"))
+    return value.attr("__index__")().cast<int64_t>();
+
+  if (py::hasattr(value, "__float__"))
+    return value.attr("__float__")().cast<double>();
+
+  throw py::type_error("Unsupported override value: " + py::repr(value).cast<std::string>());
+}
+
+struct PyResult
+{
+  std::string testType;
+  uint32_t batches = 0;
+  uint32_t iterations = 0;
+  float seconds = 0.0;
+
+  float mean = 0.0;
+  float variance = 0.0;
+
+  // Batch estimates with several batches, else running estimates per iteration
+  std::vector<float> samples;
+};
+
+class PyLevel
+{
+public:
+  PyLevel(const std::string& configFile)
+      : mConfigFile(configFile)
+  {
+    if (IsCompiledLevel(configFile))
+    {
+      if (!LoadCompiledLevel(configFile, mBlueprint))
+        throw std::runtime_error("Failed to load compiled level: " + configFile);
+
+      return;
+    }
+
+    std::ifstream f(configFile);
+    if (!f.is_open())
+      throw std::runtime_error("Could not open file: " + configFile);
+
+    mConfig = json::parse(f);
+    if (mConfig.contains("floors"))
+      throw std::runtime_error("Buildings are not supported, load one of their floors instead");
+
+    if (!mBlueprint.Init(mConfig))
+      throw std::runtime_error("Invalid configuration file: " + configFile);
+  }
+
+  PyResult Run(uint32_t iterations, uint32_t batches, uint64_t seed, const py::dict& overrides,
+               uint32_t threads, uint32_t timeStep, uint32_t replicas,
+               bool commonRandom, bool antithetic) const
+  {
+    // Overrides need a blueprint of their own, the walls rarely change so
+    // the navigation data is usually shared
+    Blueprint overridden;
+    const Blueprint* blueprint = &mBlueprint;
+    if (!overrides.empty())
+    {
+      if (mConfig.is_null())
+        throw std::runtime_error("Parameters of a compiled level cannot be overwritten, use the JSON config instead");
+
+      json config = mConfig;
+      for (const auto& item : overrides)
+      {
+        std::string path = item.first.cast<std::string>();
+        if (!SetConfigValue(config, path, ToJson(item.second)))
+          throw std::invalid_argument("Cannot set " + path);
+      }
+
+      if (!overridden.Init(config, mBlueprint.navigation))
+        throw std::invalid_argument("Invalid overrides for " + mConfigFile);
+
+      blueprint = &overridden;
+    }
+
+    Args args;
+    args.hidden = true;
+    args.batches = std::max<uint32_t>(batches, 1);
+    args.iterations = iterations > 0 ? iterations : blueprint->iterations;
+    args.seed = seed;
+    args.threads = threads;
+    args.timeStep = timeStep;
+    args.replicas = replicas;
+    args.commonRandom = commonRandom;
+    args.antithetic = antithetic;
+
+    // result.samples of a single batch are its iterations
+    args.keepSamples = true;
+
+    PyResult result;
+    result.testType = blueprint->testType;
+    result.batches = args.batches;
+    result.iterations = args.iterations;
+
+    Statistics stats(blueprint->testType, blueprint->dayDuration, args.batches, args.iterations);
+    bool ok = true;
+    {
+      // Other Python threads keep running while the batches are simulated
+      py::gil_scoped_release release;
+      auto start = std::chrono::steady_clock::now();
+
+      BatchRunner runner(args.threads);
+      for (uint32_t i = 0; i < args.batches; ++i)
+        runner.Add(*blueprint, args, i, args.iterations);
+
+      runner.Start();
+
+      for (uint32_t i = 0; ok && i < args.batches; ++i)
+      {
+        auto batch = runner.Next();
+        ok = batch.ok;
+        if (ok)
+          stats.Merge(*batch.stats);
+      }
+
+      result.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (!ok)
+      throw std::runtime_error("Failed to set up the simulation");
+
+    auto testStats = stats.GetStats();
+    result.mean = testStats.mean;
+    result.variance = testStats.variance;
+    result.samples = stats.Samples();
+
+    return result;
+  }
+
+  const Blueprint& GetBlueprint() const
+  {
+    return mBlueprint;
+  }
+
+private:
+  std::string mConfigFile;
+  json mConfig;   // Null for compiled levels
+  Blueprint mBlueprint;
+};
+
+PYBIND11_MODULE(intrusion, m)
+{
+  m.doc() = "Intrusion game simulator";
+
+  py::class_<PyResult>(m, "Result")
+    .def_readonly("test_type", &PyResult::testType)
+    .def_readonly("batches", &PyResult::batches)
+    .def_readonly("iterations", &PyResult::iterations)
+    .def_readonly("seconds", &PyResult::seconds)
+    .def_readonly("mean", &PyResult::mean)
+    .def_readonly("variance", &PyResult::variance)
+    .def_property_readonly("samples", [](py::object self)
+      {
+        // A view of the C++ vector, the result object stays alive as its base
+        auto& result = self.cast<PyResult&>();
+        return py::array_t<float>(result.samples.size(), result.samples.data(), self);
+      })
+    .def("__repr__", [](const PyResult& result)
+      {
+        return "<Result " + result.testType + " mean=" + std::to_string(result.mean) +
+               " variance=" + std::to_string(result.variance) + ">";
+      });
+
+  py::class_<PyLevel>(m, "Level")
+    .def(py::init<const std::string&>(), py::arg("config"),
+         "Load a JSON or compiled level")
+    .def("run", &PyLevel::Run,
+         py::arg("iterations") = 0,
+         py::arg("batches") = 1,
+         py::arg("seed") = 0,
+         py::arg("overrides") = py::dict(),
+         py::arg("threads") = 1,
+         py::arg("time_step") = 1,
+         py::arg("replicas") = 1,
+         py::arg("common_random") = false,
+         py::arg("antithetic") = false,
+         "Simulate batches of iterations, overrides map level paths like "
+         "\"guards/config/*/stroll_speed\" to new values. 0 iterations uses the level's")
+    .def_property_readonly("name", [](const PyLevel& level){ return level.GetBlueprint().level; })
+    .def_property_readonly("test_type", [](const PyLevel& level){ return level.GetBlueprint().testType; })
+    .def_property_readonly("observed_mean", [](const PyLevel& level){ return level.GetBlueprint().observedMean; })
+    .def_property_readonly("iterations", [](const PyLevel& level){ return level.GetBlueprint().iterations; });
+}
@@ -1,16 +1,23 @@
 #pragma once
 
-#include <memory>
-#include <string>
-#include <random>
+#include <stdint.h>
+#include <cmath>
 
+// Counter based generator: the n-th number of a sequence is a hash of the
+// sequence key and n (SplitMix64). A randomizer is only a key, a counter and
+// its range, and keys are derived from (seed, batch, iteration, entity), so
+// any iteration gives the same numbers no matter which thread simulates it.
+// A mirrored sequence gives 1 - u for every uniform u of the plain one, and
+// normals mirrored around their mean, for antithetic pairs of iterations.
 class Randomizer
 {
 public:
   Randomizer(float a, float b)
-      : mGen(mRd())
-      , mDist(a, b)
-      , mNormalDist(a, b)
+      : mKey(0)
+      , mCounter(0)
+      , mMirrored(false)
+      , mA(a)
+      , mB(b)
   {
   }
 
@@ -18,19 +25,97 @@ public:
   {
   }
 
+  // Uniform in [a, b)
   float Uniform()
   {
-    return mDist(mGen);
+    return mA + (mB - mA) * Unit();
   }
 
+  // Normal with mean a and standard deviation b
   float Normal()
   {
-    return mNormalDist(mGen);
+    // Box-Muller, 1 - u keeps the logarithm finite. Mirroring the uniforms
+    // would not mirror the cosine, so the result is mirrored instead
+    float u1 = 1.0f - ToUnit(Next());
+    float u2 = ToUnit(Next());
+    float z = std::sqrt(-2.0f * std::log(u1)) * std::cos(6.2831853f * u2);
+    return mA + mB * (mMirrored ? -z : z);
+  }
+
+  // Uniformly pick one of size elements
+  uint32_t Index(uint32_t size)
+  {
+    return uint32_t(((Bits() >> 32) * size) >> 32);
+  }
+
+  // Everything needed to continue the same sequence later on
+  struct State
+  {
+    uint64_t key = 0;
+    uint64_t counter = 0;
+    bool mirrored = false;
+  };
+
+  State Save() const
+  {
+    return State{mKey, mCounter, mMirrored};
+  }
+
+  void Restore(const State& state)
+  {
+    mKey = state.key;
+    mCounter = state.counter;
+    mMirrored = state.mirrored;
+  }
+
+  // Start the sequence of the given key from its beginning
+  void Seed(uint64_t key, bool mirrored = false)
+  {
+    mKey = key;
+    mCounter = 0;
+    mMirrored = mirrored;
+  }
+
+  // Key of the sequence numbered index below key, e.g. an entity of an iteration
+  static uint64_t Key(uint64_t key, uint64_t index)
+  {
+    return Mix(key ^ Mix(index + 0x9E3779B97F4A7C15ull));
   }
 
 private:
-  std::random_device mRd;
-  std::mt19937 mGen;
-  std::normal_distribution<float> mNormalDist;
-  std::uniform_real_distribution<float> mDist;
-};
\ No newline at end of file
+  uint64_t mKey;
+  uint64_t mCounter;
+  bool mMirrored;
+
+  float mA;
+  float mB;
+
+  static uint64_t Mix(uint64_t x)
+  {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+  }
+
+  uint64_t Next()
+  {
+    return Mix(mKey + 0x9E3779B97F4A7C15ull * ++mCounter);
+  }
+
+  // Inverting every bit mirrors both Unit and Index within their range
+  uint64_t Bits()
+  {
+    return mMirrored ? ~Next() : Next();
+  }
+
+  // Uniform in [0, 1) from the top 24 bits
+  static float ToUnit(uint64_t bits)
+  {
+    return (bits >> 40) * (1.0f / 16777216.0f);
+  }
+
+  float Unit()
+  {
+    return ToUnit(Bits());
+  }
+};
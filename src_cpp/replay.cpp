@@ -0,0 +1,727 @@
+#include "replay.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <thread>
+
+#include "helpers.h"
+
+static const char REPLAY_MAGIC[8] = { 'I', 'G', 'R', 'E', 'P', 'L', 'A', 'Y' };
+
+// Low three bits of every event header, the subject is stored above them
+enum EventType : uint32_t
+{
+  EVENT_PATH = 0,     // Moved somewhere else or was given a new path
+  EVENT_STEP,         // Walked another number of points per tick
+  EVENT_CHECK_START,
+  EVENT_CHECK_STOP,
+  EVENT_ENTER,        // Came onto this floor
+  EVENT_LEAVE,
+  EVENT_DOOR,         // The subject is a door, which opened or closed
+  EVENT_END           // Outcome of the iteration
+};
+
+// Ten minutes of the day, a tick is a second
+static const int32_t SEEK_TICKS = 10 * 60;
+
+static void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out.push_back(uint8_t(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(uint8_t(value));
+}
+
+// Zigzag, so small negative numbers stay short too
+static void PutSigned(std::vector<uint8_t>& out, int64_t value)
+{
+  PutVarint(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+static void PutString(std::vector<uint8_t>& out, const std::string& text)
+{
+  PutVarint(out, text.size());
+  out.insert(out.end(), text.begin(), text.end());
+}
+
+static bool GetVarint(const std::vector<uint8_t>& in, size_t& cursor, size_t end, uint64_t& value)
+{
+  value = 0;
+  for (uint32_t shift = 0; cursor < end && shift < 64; shift += 7)
+  {
+    uint8_t byte = in[cursor++];
+    value |= uint64_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+static bool GetSigned(const std::vector<uint8_t>& in, size_t& cursor, size_t end, int64_t& value)
+{
+  uint64_t zigzag;
+  RETURN_ON_FAILURE(GetVarint(in, cursor, end, zigzag));
+
+  value = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+  return true;
+}
+
+template <typename T>
+static bool Get(const std::vector<uint8_t>& in, size_t& cursor, size_t end, T& value)
+{
+  uint64_t v;
+  RETURN_ON_FAILURE(GetVarint(in, cursor, end, v));
+
+  value = T(v);
+  return true;
+}
+
+static bool GetString(const std::vector<uint8_t>& in, size_t& cursor, size_t end, std::string& text)
+{
+  uint64_t size;
+  RETURN_ON_FAILURE(GetVarint(in, cursor, end, size));
+  LOG_AND_RETURN_ON_FAILURE(size <= end - cursor, "Replay file is truncated");
+
+  text.assign(in.begin() + cursor, in.begin() + cursor + size);
+  cursor += size;
+  return true;
+}
+
+static int64_t Pixel(float value)
+{
+  return std::lround(value);
+}
+
+static void PutPath(std::vector<uint8_t>& out, const Point& from, const Point* points, uint32_t count)
+{
+  PutVarint(out, count);
+
+  // Paths go from tile to tile, so every delta fits into a byte
+  Point last = from;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    PutSigned(out, Pixel(points[i].x) - Pixel(last.x));
+    PutSigned(out, Pixel(points[i].y) - Pixel(last.y));
+    last = points[i];
+  }
+}
+
+uint32_t ReplayTrack::Remaining() const
+{
+  return path.size() - next;
+}
+
+void ReplayTrack::Predict()
+{
+  lastPos = pos;
+  lastNext = next;
+
+  if (advance == 0 || Remaining() == 0)
+    return;
+
+  // Only a single point when the rest of the path is shorter than a step
+  uint32_t index = Remaining() > advance - 1 ? advance - 1 : 0;
+  pos = path[next + index];
+  next += index + 1;
+}
+
+void ReplayTrack::Step(uint32_t advance)
+{
+  this->advance = advance;
+  pos = lastPos;
+  next = lastNext;
+
+  if (advance > 0)
+  {
+    pos = path[next + advance - 1];
+    next += advance;
+  }
+}
+
+void ReplayTrack::SetPath(const Point& pos, const Point* points, uint32_t count)
+{
+  this->pos = pos;
+  path.assign(points, points + count);
+  next = 0;
+}
+
+Recorder::Recorder(const std::string& filename)
+    : mFilename(filename)
+    , mIteration(0)
+    , mLastTick(0)
+{
+}
+
+Recorder::~Recorder()
+{
+}
+
+bool Recorder::Init(const std::string& name, const Level& level, const Settings& settings, uint32_t totalTicks)
+{
+  mFile.open(mFilename, std::ios::binary | std::ios::trunc);
+  if (!mFile.is_open())
+  {
+    printf("Could not open replay file: %s\n", mFilename.c_str());
+    return false;
+  }
+
+  for (const auto& guard : level.Guards())
+    mMovables.push_back(guard.get());
+
+  for (const auto& employee : level.Employees())
+    mMovables.push_back(employee.get());
+
+  for (const auto& attacker : level.Attackers())
+    mMovables.push_back(attacker.get());
+
+  mTracks.resize(mMovables.size());
+  mPathsFound.resize(mMovables.size());
+  mDoors.resize(level.Doors().size());
+
+  std::vector<uint8_t> header(std::begin(REPLAY_MAGIC), std::end(REPLAY_MAGIC));
+  PutVarint(header, REPLAY_VERSION);
+  PutString(header, name);
+
+  PutVarint(header, settings.width);
+  PutVarint(header, settings.height);
+  PutVarint(header, settings.fps);
+  PutVarint(header, settings.cyclesPerFrame);
+  PutVarint(header, settings.timeStep);
+  PutVarint(header, totalTicks);
+
+  PutVarint(header, level.Walls().size());
+  for (const auto& wall : level.Walls())
+  {
+    PutSigned(header, Pixel(wall.p1.x));
+    PutSigned(header, Pixel(wall.p1.y));
+    PutSigned(header, Pixel(wall.p2.x));
+    PutSigned(header, Pixel(wall.p2.y));
+  }
+
+  PutVarint(header, level.Doors().size());
+  for (const auto& door : level.Doors())
+  {
+    Rect area = door->Area();
+    PutSigned(header, area.x);
+    PutSigned(header, area.y);
+    PutSigned(header, area.w);
+    PutSigned(header, area.h);
+  }
+
+  PutVarint(header, level.Guards().size() + level.Employees().size());
+  PutVarint(header, level.Attackers().size());
+  for (const auto* movable : mMovables)
+  {
+    Color color = movable->GetColor();
+    header.push_back(color.r);
+    header.push_back(color.g);
+    header.push_back(color.b);
+  }
+
+  mFile.write(reinterpret_cast<const char*>(header.data()), header.size());
+  LOG_AND_RETURN_ON_FAILURE(mFile.good(), "Failed to write replay file");
+
+  return true;
+}
+
+void Recorder::Begin(uint32_t iteration, const Level& level)
+{
+  mIteration = iteration;
+  mLastTick = 0;
+  mEvents.clear();
+
+  // Where everything starts, the rest follows from the events
+  for (uint32_t i = 0; i < mMovables.size(); ++i)
+  {
+    const Movable& movable = *mMovables[i];
+    ReplayTrack& track = mTracks[i];
+
+    const auto& path = movable.Path();
+    track.SetPath(movable.Pos(), path.data(), path.size());
+    track.advance = 0;
+    track.checking = movable.IsChecking();
+    track.present = movable.IsPresent();
+    mPathsFound[i] = movable.PathsFound();
+
+    PutSigned(mEvents, Pixel(track.pos.x));
+    PutSigned(mEvents, Pixel(track.pos.y));
+    PutVarint(mEvents, uint32_t(track.checking) | uint32_t(track.present) << 1);
+    PutPath(mEvents, track.pos, path.data(), path.size());
+  }
+
+  const auto& doors = level.Doors();
+  for (uint32_t i = 0; i < doors.size(); ++i)
+  {
+    mDoors[i] = doors[i]->IsOpen();
+    mEvents.push_back(mDoors[i]);
+  }
+}
+
+void Recorder::Tick(uint32_t ticks, const Level& level)
+{
+  for (uint32_t i = 0; i < mMovables.size(); ++i)
+    Record(ticks, i, *mMovables[i]);
+
+  const auto& doors = level.Doors();
+  for (uint32_t i = 0; i < doors.size(); ++i)
+  {
+    if (doors[i]->IsOpen() == bool(mDoors[i]))
+      continue;
+
+    mDoors[i] = !mDoors[i];
+    Event(ticks, i, EVENT_DOOR);
+  }
+}
+
+void Recorder::Record(uint32_t ticks, uint32_t track, const Movable& movable)
+{
+  ReplayTrack& t = mTracks[track];
+
+  if (movable.IsChecking() != t.checking)
+  {
+    t.checking = !t.checking;
+    Event(ticks, track, t.checking ? EVENT_CHECK_START : EVENT_CHECK_STOP);
+  }
+
+  if (movable.IsPresent() != t.present)
+  {
+    t.present = !t.present;
+    Event(ticks, track, t.present ? EVENT_ENTER : EVENT_LEAVE);
+  }
+
+  t.Predict();
+
+  Point pos = movable.Pos();
+  const auto& path = movable.Path();
+  bool newPath = movable.PathsFound() != mPathsFound[track];
+  if (!newPath && pos == t.pos && path.size() == t.Remaining())
+    return;
+
+  mPathsFound[track] = movable.PathsFound();
+
+  // Still on the same path, only at another pace
+  uint32_t before = t.path.size() - t.lastNext;
+  if (!newPath && path.size() <= before)
+  {
+    uint32_t walked = before - path.size();
+    Point reached = walked > 0 ? t.path[t.lastNext + walked - 1] : t.lastPos;
+    if (reached == pos)
+    {
+      Event(ticks, track, EVENT_STEP);
+      PutVarint(mEvents, walked);
+      t.Step(walked);
+      return;
+    }
+  }
+
+  Event(ticks, track, EVENT_PATH);
+  PutSigned(mEvents, Pixel(pos.x) - Pixel(t.pos.x));
+  PutSigned(mEvents, Pixel(pos.y) - Pixel(t.pos.y));
+  PutPath(mEvents, pos, path.data(), path.size());
+  t.SetPath(pos, path.data(), path.size());
+}
+
+void Recorder::Event(uint32_t ticks, uint32_t subject, uint32_t type)
+{
+  PutVarint(mEvents, ticks - mLastTick);
+  PutVarint(mEvents, subject << 3 | type);
+  mLastTick = ticks;
+}
+
+bool Recorder::End(uint32_t ticks, const Result& result)
+{
+  Event(ticks, 0, EVENT_END);
+  PutVarint(mEvents, result.success);
+  PutVarint(mEvents, result.doorStats.successes);
+  PutVarint(mEvents, result.doorStats.failures);
+
+  std::vector<uint8_t> record;
+  PutVarint(record, mIteration);
+  PutVarint(record, mEvents.size());
+
+  mFile.write(reinterpret_cast<const char*>(record.data()), record.size());
+  mFile.write(reinterpret_cast<const char*>(mEvents.data()), mEvents.size());
+  LOG_AND_RETURN_ON_FAILURE(mFile.good(), "Failed to write replay file");
+
+  return true;
+}
+
+ReplayPlayer::ReplayPlayer()
+    : mTotalTicks(0)
+    , mMovables(0)
+    , mPaused(false)
+    , mSeek(0)
+    , mSpeed(1)
+    , mTicks(0)
+    , mCursor(0)
+    , mNextEvent(0)
+    , mEnded(false)
+{
+}
+
+ReplayPlayer::~ReplayPlayer()
+{
+}
+
+bool ReplayPlayer::Load(const std::string& filename)
+{
+  std::ifstream f(filename, std::ios::binary);
+  if (!f.is_open())
+  {
+    printf("Could not open replay file: %s\n", filename.c_str());
+    return false;
+  }
+
+  mData.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+
+  bool isReplay = mData.size() >= sizeof(REPLAY_MAGIC) && memcmp(mData.data(), REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) == 0;
+  LOG_AND_RETURN_ON_FAILURE(isReplay, "Not a replay file");
+
+  size_t cursor = sizeof(REPLAY_MAGIC);
+  const size_t end = mData.size();
+
+  uint32_t version;
+  RETURN_ON_FAILURE(Get(mData, cursor, end, version));
+  if (version != REPLAY_VERSION)
+  {
+    printf("Replay file version %u is not supported, expected %u\n", version, REPLAY_VERSION);
+    return false;
+  }
+
+  bool ok = GetString(mData, cursor, end, mName) &&
+            Get(mData, cursor, end, mSettings.width) &&
+            Get(mData, cursor, end, mSettings.height) &&
+            Get(mData, cursor, end, mSettings.fps) &&
+            Get(mData, cursor, end, mSettings.cyclesPerFrame) &&
+            Get(mData, cursor, end, mSettings.timeStep) &&
+            Get(mData, cursor, end, mTotalTicks);
+
+  uint32_t walls = 0;
+  ok = ok && Get(mData, cursor, end, walls);
+  for (uint32_t i = 0; ok && i < walls; ++i)
+  {
+    int64_t x1, y1, x2, y2;
+    ok = GetSigned(mData, cursor, end, x1) && GetSigned(mData, cursor, end, y1) &&
+         GetSigned(mData, cursor, end, x2) && GetSigned(mData, cursor, end, y2);
+    mWalls.push_back(Line(x1, y1, x2, y2));
+  }
+
+  uint32_t doors = 0;
+  ok = ok && Get(mData, cursor, end, doors);
+  for (uint32_t i = 0; ok && i < doors; ++i)
+  {
+    int64_t x, y, w, h;
+    ok = GetSigned(mData, cursor, end, x) && GetSigned(mData, cursor, end, y) &&
+         GetSigned(mData, cursor, end, w) && GetSigned(mData, cursor, end, h);
+    mDoorAreas.push_back(Rect{int(x), int(y), int(w), int(h)});
+  }
+
+  uint32_t attackers = 0;
+  ok = ok && Get(mData, cursor, end, mMovables) && Get(mData, cursor, end, attackers);
+  ok = ok && 3 * size_t(mMovables + attackers) <= end - cursor;
+  for (uint32_t i = 0; ok && i < mMovables + attackers; ++i, cursor += 3)
+    mColors.push_back(Color{mData[cursor], mData[cursor + 1], mData[cursor + 2]});
+
+  LOG_AND_RETURN_ON_FAILURE(ok, "Replay file header is truncated");
+
+  while (cursor < end)
+  {
+    Iteration iteration;
+    uint64_t bytes;
+    if (!Get(mData, cursor, end, iteration.number) || !GetVarint(mData, cursor, end, bytes) || bytes > end - cursor)
+    {
+      // What a crashed run managed to write is still worth looking at
+      printf("Replay file is truncated after %zu iterations\n", mIterations.size());
+      break;
+    }
+
+    iteration.begin = cursor;
+    iteration.end = cursor + bytes;
+    mIterations.push_back(iteration);
+    cursor = iteration.end;
+  }
+
+  mTracks.resize(mColors.size());
+  mOpen.resize(mDoorAreas.size());
+  mSpeed = std::max<uint32_t>(mSettings.cyclesPerFrame, 1);
+  mSettings.timeStep = std::max<uint32_t>(mSettings.timeStep, 1);
+
+  printf("Replay of %s with %zu iterations\n", mName.c_str(), mIterations.size());
+  return true;
+}
+
+const Settings& ReplayPlayer::GetSettings() const
+{
+  return mSettings;
+}
+
+const std::vector<Line>& ReplayPlayer::Walls() const
+{
+  return mWalls;
+}
+
+uint32_t ReplayPlayer::Iterations() const
+{
+  return mIterations.size();
+}
+
+void ReplayPlayer::Pause()
+{
+  mPaused = !mPaused;
+}
+
+void ReplayPlayer::Seek(bool forward)
+{
+  mSeek += forward ? SEEK_TICKS : -SEEK_TICKS;
+}
+
+void ReplayPlayer::ChangeSpeed(bool faster)
+{
+  uint32_t speed = mSpeed;
+  mSpeed = std::max<uint32_t>(faster ? std::min<uint32_t>(speed * 2, mTotalTicks) : speed / 2, 1);
+}
+
+bool ReplayPlayer::Play(uint32_t first, const std::function<bool(const Snapshot&)>& show)
+{
+  const auto frameTime = std::chrono::microseconds(1000000 / std::max<uint32_t>(mSettings.fps, 1));
+
+  Snapshot snapshot;
+  for (uint32_t i = first; i < mIterations.size(); ++i)
+  {
+    const Iteration& iteration = mIterations[i];
+    printf("Iteration %u\n", iteration.number);
+
+    Rewind(iteration);
+    auto next = std::chrono::steady_clock::now();
+    while (true)
+    {
+      int32_t seek = mSeek.exchange(0);
+      if (seek != 0)
+      {
+        uint32_t target = std::max<int64_t>(int64_t(mTicks) + seek, 0);
+        if (target < mTicks)
+          Rewind(iteration);
+
+        while (!mEnded && mTicks < target)
+          Advance(iteration);
+      }
+
+      if (!mPaused)
+      {
+        for (uint32_t t = 0; !mEnded && t < mSpeed; t += mSettings.timeStep)
+          Advance(iteration);
+      }
+
+      Capture(snapshot);
+      if (!show(snapshot))
+        return false;
+
+      if (mEnded && !mPaused)
+        break;
+
+      // Catch up after falling behind instead of rushing
+      next += frameTime;
+      auto now = std::chrono::steady_clock::now();
+      if (next < now)
+        next = now;
+      std::this_thread::sleep_until(next);
+    }
+
+    printf("  %s after %u ticks, %u entered and %u blocked doors\n", mResult.success ? "Success" : "Failure",
+           mTicks, mResult.doorStats.successes, mResult.doorStats.failures);
+  }
+
+  return true;
+}
+
+void ReplayPlayer::Rewind(const Iteration& iteration)
+{
+  mCursor = iteration.begin;
+  mTicks = 0;
+  mEnded = false;
+  mResult = Result();
+
+  bool ok = true;
+  std::vector<Point> points;
+  for (auto& track : mTracks)
+  {
+    int64_t x, y;
+    uint32_t flags = 0;
+    ok = ok && GetSigned(mData, mCursor, iteration.end, x) && GetSigned(mData, mCursor, iteration.end, y) &&
+         Get(mData, mCursor, iteration.end, flags);
+
+    track.pos = Point(x, y);
+    track.advance = 0;
+    track.checking = flags & 1;
+    track.present = flags & 2;
+
+    uint32_t count = 0;
+    ok = ok && Get(mData, mCursor, iteration.end, count);
+
+    points.clear();
+    Point last = track.pos;
+    for (uint32_t i = 0; ok && i < count; ++i)
+    {
+      ok = GetSigned(mData, mCursor, iteration.end, x) && GetSigned(mData, mCursor, iteration.end, y);
+      last = Point(last.x + x, last.y + y);
+      points.push_back(last);
+    }
+    track.SetPath(track.pos, points.data(), points.size());
+  }
+
+  for (auto& open : mOpen)
+  {
+    ok = ok && mCursor < iteration.end;
+    open = ok && mData[mCursor++];
+  }
+
+  if (!ok || !ReadNextTick(iteration))
+  {
+    printf("Iteration %u of the replay is damaged\n", iteration.number);
+    mEnded = true;
+    return;
+  }
+
+  ApplyEvents(iteration);
+}
+
+bool ReplayPlayer::ReadNextTick(const Iteration& iteration)
+{
+  uint32_t delta;
+  RETURN_ON_FAILURE(Get(mData, mCursor, iteration.end, delta));
+
+  mNextEvent = mTicks + delta;
+  return true;
+}
+
+void ReplayPlayer::Advance(const Iteration& iteration)
+{
+  if (mEnded)
+    return;
+
+  mTicks += mSettings.timeStep;
+  for (auto& track : mTracks)
+    track.Predict();
+
+  ApplyEvents(iteration);
+}
+
+void ReplayPlayer::ApplyEvents(const Iteration& iteration)
+{
+  auto& points = mPoints;
+  const size_t end = iteration.end;
+  bool ok = true;
+  while (ok && !mEnded && mNextEvent <= mTicks)
+  {
+    uint32_t header;
+    ok = Get(mData, mCursor, end, header);
+
+    uint32_t subject = header >> 3;
+    uint32_t type = header & 7;
+    if (type == EVENT_DOOR)
+      ok = ok && subject < mOpen.size();
+    else if (type != EVENT_END)
+      ok = ok && subject < mTracks.size();
+
+    if (!ok)
+      break;
+
+    switch (type)
+    {
+    case EVENT_PATH:
+      {
+        ReplayTrack& track = mTracks[subject];
+        int64_t x, y;
+        uint32_t count = 0;
+        ok = GetSigned(mData, mCursor, end, x) && GetSigned(mData, mCursor, end, y) && Get(mData, mCursor, end, count);
+
+        Point pos(track.pos.x + x, track.pos.y + y);
+        points.clear();
+        Point last = pos;
+        for (uint32_t i = 0; ok && i < count; ++i)
+        {
+          ok = GetSigned(mData, mCursor, end, x) && GetSigned(mData, mCursor, end, y);
+          last = Point(last.x + x, last.y + y);
+          points.push_back(last);
+        }
+        track.SetPath(pos, points.data(), points.size());
+      }
+      break;
+    case EVENT_STEP:
+      {
+        ReplayTrack& track = mTracks[subject];
+        uint32_t walked = 0;
+        ok = Get(mData, mCursor, end, walked) && walked <= track.path.size() - track.lastNext;
+        if (ok)
+          track.Step(walked);
+      }
+      break;
+    case EVENT_CHECK_START:
+    case EVENT_CHECK_STOP:
+      mTracks[subject].checking = type == EVENT_CHECK_START;
+      break;
+    case EVENT_ENTER:
+    case EVENT_LEAVE:
+      mTracks[subject].present = type == EVENT_ENTER;
+      break;
+    case EVENT_DOOR:
+      mOpen[subject] = !mOpen[subject];
+      break;
+    case EVENT_END:
+      ok = Get(mData, mCursor, end, mResult.success) &&
+           Get(mData, mCursor, end, mResult.doorStats.successes) &&
+           Get(mData, mCursor, end, mResult.doorStats.failures);
+      mResult.ticksElapsed = float(mTicks) / 60;
+      mEnded = true;
+      break;
+    }
+
+    ok = ok && (mEnded || ReadNextTick(iteration));
+  }
+
+  if (!ok)
+  {
+    printf("Iteration %u of the replay is damaged\n", iteration.number);
+    mEnded = true;
+  }
+}
+
+void ReplayPlayer::Capture(Snapshot& snapshot) const
+{
+  snapshot.movables.clear();
+  snapshot.attackers.clear();
+  snapshot.paths.clear();
+  snapshot.doors.clear();
+
+  for (uint32_t i = 0; i < mTracks.size(); ++i)
+  {
+    const ReplayTrack& track = mTracks[i];
+    if (i >= mMovables && !track.present)
+      continue;
+
+    Snapshot::Body body;
+    body.x = track.pos.x;
+    body.y = track.pos.y;
+    body.color = mColors[i];
+    body.checking = track.checking;
+
+    body.pathBegin = snapshot.paths.size();
+    snapshot.paths.insert(snapshot.paths.end(), track.path.begin() + track.next, track.path.end());
+    body.pathEnd = snapshot.paths.size();
+
+    (i < mMovables ? snapshot.movables : snapshot.attackers).push_back(body);
+  }
+
+  for (uint32_t i = 0; i < mDoorAreas.size(); ++i)
+    snapshot.doors.push_back(Snapshot::DoorState{mDoorAreas[i], bool(mOpen[i])});
+
+  snapshot.ticks = mTicks;
+  snapshot.totalTicks = mTotalTicks;
+}
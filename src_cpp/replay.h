@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "level.h"
+#include "settings.h"
+#include "snapshot.h"
+
+// Replay files hold every iteration of one batch as a compact event log,
+// enough to draw the iteration again without simulating it.
+//
+// Layout: a header with the level geometry and the colour of every entity,
+// followed by one record per iteration, each a varint iteration number, a
+// varint byte length and the events. Numbers are LEB128 varints, signed ones
+// zigzag encoded first, and positions are whole pixels.
+//
+// Instead of positions every tick, the log only holds what cannot be
+// predicted: every entity walks the path it was last given at the pace it
+// last walked, and an event is written whenever it does something else.
+// Entities are numbered guards first, then employees, then attackers.
+
+static const uint32_t REPLAY_VERSION = 1;
+
+// Position and path of one entity as far as a replay knows them. The
+// recorder predicts with exactly the same code the player replays with
+struct ReplayTrack
+{
+  Point pos;
+  std::vector<Point> path;
+  uint32_t next = 0;     // First point of path still to be walked
+  uint32_t advance = 0;  // Points walked per tick, 0 while standing still
+
+  bool checking = false;
+  bool present = true;
+
+  // Before the last Predict, for events which replace it
+  Point lastPos;
+  uint32_t lastNext = 0;
+
+  uint32_t Remaining() const;
+
+  // One more tick at the last pace, the way Movable::Move walks a path
+  void Predict();
+
+  // Walk advance points in the last tick instead and keep that pace
+  void Step(uint32_t advance);
+
+  void SetPath(const Point& pos, const Point* points, uint32_t count);
+};
+
+// Writes the replay of every iteration a simulation runs, see Simulation::Run
+class Recorder
+{
+public:
+  Recorder(const std::string& filename);
+  ~Recorder();
+
+  bool Init(const std::string& name, const Level& level, const Settings& settings, uint32_t totalTicks);
+
+  // The level has just been reset for iteration
+  void Begin(uint32_t iteration, const Level& level);
+
+  // Compare the level with the prediction after every update
+  void Tick(uint32_t ticks, const Level& level);
+
+  bool End(uint32_t ticks, const Result& result);
+
+private:
+  std::string mFilename;
+  std::ofstream mFile;
+
+  std::vector<const Movable*> mMovables;
+  std::vector<ReplayTrack> mTracks;
+  std::vector<uint32_t> mPathsFound;
+  std::vector<uint8_t> mDoors;
+
+  uint32_t mIteration;
+  uint32_t mLastTick;
+  std::vector<uint8_t> mEvents;
+
+  void Event(uint32_t ticks, uint32_t subject, uint32_t type);
+  void Record(uint32_t ticks, uint32_t track, const Movable& movable);
+};
+
+// Shows the iterations of a replay file through the display, see Game
+class ReplayPlayer
+{
+public:
+  ReplayPlayer();
+  ~ReplayPlayer();
+
+  bool Load(const std::string& filename);
+
+  const Settings& GetSettings() const;
+  const std::vector<Line>& Walls() const;
+
+  uint32_t Iterations() const;
+
+  // Play the iterations from the first one on, at the pace of the original
+  // game, handing one snapshot per frame to show. Stops early once show
+  // returns false
+  bool Play(uint32_t first, const std::function<bool(const Snapshot&)>& show);
+
+  // Controls, safe to call from another thread while playing. Seeking moves
+  // by ten minutes of the day, the speed doubles or halves
+  void Pause();
+  void Seek(bool forward);
+  void ChangeSpeed(bool faster);
+
+private:
+  struct Iteration
+  {
+    uint32_t number = 0;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  Settings mSettings;
+  std::string mName;
+  uint32_t mTotalTicks;
+
+  std::vector<Line> mWalls;
+  std::vector<Rect> mDoorAreas;
+  std::vector<Color> mColors;
+  uint32_t mMovables;  // Guards and employees, the attackers follow
+
+  std::vector<uint8_t> mData;
+  std::vector<Iteration> mIterations;
+
+  // Set by the display thread
+  std::atomic<bool> mPaused;
+  std::atomic<int32_t> mSeek;
+  std::atomic<uint32_t> mSpeed;
+
+  // Playback state of the current iteration
+  std::vector<ReplayTrack> mTracks;
+  std::vector<uint8_t> mOpen;
+  uint32_t mTicks;
+  size_t mCursor;
+  uint32_t mNextEvent;  // Tick of the event at mCursor
+  bool mEnded;
+  Result mResult;
+
+  // Points of the path event being read, kept so playing does not allocate
+  std::vector<Point> mPoints;
+
+  void Rewind(const Iteration& iteration);
+  bool ReadNextTick(const Iteration& iteration);
+  void Advance(const Iteration& iteration);
+  void ApplyEvents(const Iteration& iteration);
+  void Capture(Snapshot& snapshot) const;
+};
@@ -0,0 +1,122 @@
+#include "result_cache.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+
+#include "helpers.h"
+#include "randomizer.h"
+
+using json = nlohmann::json;
+
+// 128 bits from two different hashes of the text, FNV-1a and a chain of
+// the randomizer key derivation, so distinct configs never share a key
+static std::string Hash(const std::string& text)
+{
+  uint64_t a = 0xCBF29CE484222325ull;
+  uint64_t b = 0;
+  for (unsigned char c : text)
+  {
+    a = (a ^ c) * 0x100000001B3ull;
+    b = Randomizer::Key(b, c);
+  }
+
+  char buffer[33];
+  snprintf(buffer, sizeof(buffer), "%016lx%016lx", a, b);
+  return buffer;
+}
+
+ResultCache::ResultCache(const std::string& directory)
+    : mDirectory(directory)
+{
+  if (!mDirectory.empty() && mDirectory.back() != '/')
+    mDirectory += "/";
+}
+
+ResultCache::~ResultCache()
+{
+}
+
+bool ResultCache::Init()
+{
+  if (!DoesFileExist(mDirectory) && !CreateDirectory(mDirectory))
+  {
+    printf("Failed to create cache directory: %s\n", mDirectory.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+std::string ResultCache::Key(const nlohmann::json& config, const Args& args, uint32_t iterations)
+{
+  json run;
+  run["version"] = RESULTS_VERSION;
+  run["config"] = config;
+  run["seed"] = args.seed;
+  run["iterations"] = iterations;
+  run["time_step"] = args.timeStep;
+  run["replicas"] = args.replicas;
+  run["common_random"] = args.commonRandom;
+  run["antithetic"] = args.antithetic;
+  run["split_at"] = args.splitLevels;
+  run["split_factor"] = args.splitFactor;
+
+  // Entries only hold the samples of a batch when they were kept
+  run["keep_samples"] = args.keepSamples;
+
+  // Objects keep their keys sorted, so the same run always dumps the same
+  return Hash(run.dump());
+}
+
+std::string ResultCache::BatchFile(const std::string& key, uint32_t batch) const
+{
+  return mDirectory + key + "/batch_" + std::to_string(batch) + ".json";
+}
+
+bool ResultCache::Load(const std::string& key, uint32_t batch, Statistics& stats) const
+{
+  std::string batchFile = BatchFile(key, batch);
+  if (!DoesFileExist(batchFile))
+    return false;
+
+  std::ifstream f(batchFile);
+  if (!f.is_open())
+    return false;
+
+  json partial;
+  try
+  {
+    partial = json::parse(f);
+    if (partial.at("key") != key || partial.at("batch") != batch)
+      return false;
+  }
+  catch (const std::exception& e)
+  {
+    // Simulating the batch again replaces the broken entry
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return stats.MergePartial(partial);
+}
+
+bool ResultCache::Store(const std::string& key, uint32_t batch, const Statistics& stats) const
+{
+  json header;
+  header["key"] = key;
+  header["batch"] = batch;
+
+  // Written next to the entry and renamed, so a crash never leaves half a file
+  std::string batchFile = BatchFile(key, batch);
+  std::string tempFile = batchFile + ".tmp";
+  RETURN_ON_FAILURE(stats.SavePartial(tempFile, header));
+
+  if (rename(tempFile.c_str(), batchFile.c_str()) != 0)
+  {
+    printf("Failed to store cached batch: %s\n", batchFile.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "settings.h"
+#include "statistics.h"
+
+// Local cache of simulated batches, addressed by a hash of everything that
+// decides their results: the resolved level config, the seed, the number of
+// iterations per batch, the options that change the simulation and the
+// results version below. Every batch is stored on its own as
+// <directory>/<key>/batch_<n>.json, so an interrupted or extended run only
+// simulates the batches which are missing.
+//
+// Options which do not change results, like --threads or --tick-threads, are
+// not part of the key.
+
+// Bump whenever a change to the simulation changes its results, which makes
+// every result cached before unreachable
+static const uint32_t RESULTS_VERSION = 3;
+
+class ResultCache
+{
+public:
+  ResultCache(const std::string& directory);
+  ~ResultCache();
+
+  bool Init();
+
+  // Address of the batches of a level config run with args
+  static std::string Key(const nlohmann::json& config, const Args& args, uint32_t iterations);
+
+  // Append the cached batch to stats, false if it is not cached
+  bool Load(const std::string& key, uint32_t batch, Statistics& stats) const;
+
+  // Store stats, which hold exactly the given batch
+  bool Store(const std::string& key, uint32_t batch, const Statistics& stats) const;
+
+private:
+  std::string mDirectory;
+
+  std::string BatchFile(const std::string& key, uint32_t batch) const;
+};
@@ -0,0 +1,468 @@
+#include "search.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#include "batch_runner.h"
+#include "helpers.h"
+#include "level_file.h"
+#include "sweep.h"
+
+using json = nlohmann::json;
+
+// Points below this variance, e.g. where the attacker never gets in, would
+// get an infinite weight in the model
+static const double MIN_VARIANCE = 1e-8;
+
+Search::Search()
+    : mLow(0.0)
+    , mHigh(0.0)
+    , mInteger(false)
+    , mTolerance(0.0)
+    , mTarget(0.0)
+    , mMaxBatches(0)
+    , mDirection(0)
+{
+}
+
+Search::~Search()
+{
+}
+
+bool Search::Init(const std::string& searchFile)
+{
+  std::ifstream f(searchFile);
+  if (!f.is_open())
+  {
+    printf("Could not open file: %s\n", searchFile.c_str());
+    return false;
+  }
+
+  try
+  {
+    json search = json::parse(f);
+
+    mConfigFile = search["config"];
+    if (mConfigFile.front() != '/')
+      mConfigFile = RemoveFilename(searchFile) + mConfigFile;
+
+    mParameter = search["parameter"];
+    mLow = search["range"].at(0);
+    mHigh = search["range"].at(1);
+    mInteger = search.value("integer", false);
+    mTarget = search["target"];
+    mTolerance = search.value("tolerance", mInteger ? 1.0 : (mHigh - mLow) / 100);
+    mMaxBatches = search.value("max_batches", 0);
+    mName = search.value("name", "");
+
+    if (search.contains("increasing"))
+      mDirection = search["increasing"].get<bool>() ? 1 : -1;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  if (mInteger)
+  {
+    mLow = std::ceil(mLow);
+    mHigh = std::floor(mHigh);
+  }
+
+  if (!(mLow < mHigh) || !(mTolerance > 0))
+  {
+    printf("Search needs a range with two different values and a positive tolerance: %s\n", searchFile.c_str());
+    return false;
+  }
+
+  if (IsCompiledLevel(mConfigFile))
+  {
+    printf("Compiled levels cannot be searched, use the JSON config instead\n");
+    return false;
+  }
+
+  std::ifstream config(mConfigFile);
+  if (!config.is_open())
+  {
+    printf("Could not open file: %s\n", mConfigFile.c_str());
+    return false;
+  }
+
+  try
+  {
+    mConfig = json::parse(config);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  LOG_AND_RETURN_ON_FAILURE(!mConfig.contains("floors"), "Buildings cannot be searched, search one of their floors instead");
+
+  if (!mBase.Init(mConfig))
+  {
+    printf("Invalid configuration file: %s\n", mConfigFile.c_str());
+    return false;
+  }
+
+  if (mName.empty())
+  {
+    std::string parameter = mParameter.substr(mParameter.find_last_of('/') + 1);
+    mName = "search_" + parameter;
+  }
+
+  return true;
+}
+
+Search::Point* Search::AddPoint(double value)
+{
+  if (mInteger)
+    value = std::round(value);
+
+  auto it = mPoints.begin();
+  while (it != mPoints.end() && (*it)->value < value)
+    ++it;
+
+  if (it != mPoints.end() && (*it)->value == value)
+    return it->get();
+
+  auto point = std::make_unique<Point>();
+  point->value = value;
+  point->config = mConfig;
+
+  json setting = mInteger ? json(int64_t(value)) : json(value);
+  if (!SetConfigValue(point->config, mParameter, setting))
+  {
+    printf("Cannot set %s\n", mParameter.c_str());
+    return nullptr;
+  }
+
+  if (!point->blueprint.Init(point->config, mBase.navigation))
+  {
+    printf("Invalid search point %s\n", PointName(*point).c_str());
+    return nullptr;
+  }
+
+  return mPoints.insert(it, std::move(point))->get();
+}
+
+bool Search::Simulate(const Args& args, const ResultCache* cache)
+{
+  // Nothing can be shown when several points run at the same time
+  Args hidden = args;
+  hidden.hidden = true;
+
+  std::string level = GetFilename(mConfigFile);
+
+  // Batches found in the cache are not simulated again. Every point uses
+  // the same batch numbers, so neighbours share their random numbers
+  BatchRunner runner(args.threads);
+  std::vector<std::unique_ptr<Statistics>> cached;
+  for (auto& point : mPoints)
+  {
+    if (point->pending == 0)
+      continue;
+
+    const Blueprint& blueprint = point->blueprint;
+    uint32_t iterations = args.iterations > 0 ? args.iterations : blueprint.iterations;
+    if (!point->stats)
+    {
+      point->stats = std::make_unique<Statistics>(blueprint.testType, blueprint.dayDuration, 0, iterations);
+      if (cache)
+        point->cacheKey = ResultCache::Key(point->config, args, iterations);
+    }
+
+    Args pointArgs = hidden;
+    if (!args.record.empty())
+      pointArgs.record = args.record + level + "_" + PointName(*point) + "_";
+
+    uint32_t first = point->stats->Batches();
+    for (uint32_t i = first; i < first + point->pending; ++i)
+    {
+      auto stats = std::make_unique<Statistics>(blueprint.testType, blueprint.dayDuration, 1, iterations);
+      if (cache && cache->Load(point->cacheKey, i, *stats))
+      {
+        cached.push_back(std::move(stats));
+        continue;
+      }
+
+      cached.push_back(nullptr);
+      runner.Add(blueprint, pointArgs, i, iterations);
+    }
+  }
+
+  runner.Start();
+
+  uint32_t next = 0;
+  for (auto& point : mPoints)
+  {
+    uint32_t first = point->stats ? point->stats->Batches() : 0;
+    for (uint32_t i = first; i < first + point->pending; ++i)
+    {
+      auto& entry = cached[next++];
+      if (entry)
+      {
+        point->stats->Merge(*entry);
+        continue;
+      }
+
+      auto batch = runner.Next();
+      LOG_AND_RETURN_ON_FAILURE(batch.ok, "Failed to set up the simulation");
+
+      if (cache)
+        cache->Store(point->cacheKey, i, *batch.stats);
+
+      point->stats->Merge(*batch.stats);
+    }
+
+    if (point->pending > 0)
+    {
+      point->stats->SetBatches(point->stats->Batches());
+      point->pending = 0;
+    }
+  }
+
+  return true;
+}
+
+void Search::Fit(float z)
+{
+  // Pool adjacent violators: neighbouring points which are out of order are
+  // merged into a block at their weighted mean until the fit increases
+  struct Block
+  {
+    double weight = 0.0;
+    double sum = 0.0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+  };
+
+  std::vector<Block> blocks;
+  for (uint32_t i = 0; i < mPoints.size(); ++i)
+  {
+    auto stats = mPoints[i]->stats->GetStats();
+    double weight = stats.count / std::max<double>(stats.variance, MIN_VARIANCE);
+    blocks.push_back(Block{weight, weight * mDirection * stats.mean, i, i});
+
+    while (blocks.size() > 1)
+    {
+      Block& previous = blocks[blocks.size() - 2];
+      const Block& last = blocks.back();
+      if (previous.sum / previous.weight < last.sum / last.weight)
+        break;
+
+      previous.weight += last.weight;
+      previous.sum += last.sum;
+      previous.last = last.last;
+      blocks.pop_back();
+    }
+  }
+
+  float target = mDirection * mTarget;
+  for (const auto& block : blocks)
+  {
+    float fitted = block.sum / block.weight;
+    float halfWidth = z / std::sqrt(block.weight);
+    for (uint32_t i = block.first; i <= block.last; ++i)
+    {
+      auto& point = *mPoints[i];
+      point.fitted = fitted;
+      point.halfWidth = halfWidth;
+      point.side = fitted + halfWidth < target ? -1 : (fitted - halfWidth > target ? 1 : 0);
+    }
+  }
+}
+
+double Search::Crossing() const
+{
+  // The fit only increases, so the first point at or past the target
+  // ends the segment which crosses it
+  float target = mDirection * mTarget;
+  for (uint32_t i = 0; i < mPoints.size(); ++i)
+  {
+    const auto& point = *mPoints[i];
+    if (point.fitted < target)
+      continue;
+
+    if (i == 0)
+      return point.value;
+
+    const auto& previous = *mPoints[i - 1];
+    return previous.value + (target - previous.fitted) / (point.fitted - previous.fitted) * (point.value - previous.value);
+  }
+
+  return mPoints.back()->value;
+}
+
+std::string Search::PointName(const Point& point) const
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%g", point.value);
+  return buffer;
+}
+
+bool Search::Run(const Args& args, const std::string& confidence, const std::string& outDirectory, const ResultCache* cache)
+{
+  // The weight of a point needs the variance of its batches
+  uint32_t batches = std::max<uint32_t>(args.batches, 2);
+  if (args.batches < 2)
+    printf("Searching with 2 batches per round, the variance of a point needs at least 2\n");
+
+  uint32_t maxBatches = mMaxBatches > 0 ? mMaxBatches : 16 * batches;
+
+  std::string directory = outDirectory + mName + "/";
+  std::string level = GetFilename(mConfigFile);
+
+  // Statistics::Save only creates the last directory
+  if (!DoesFileExist(outDirectory) && !CreateDirectory(outDirectory))
+  {
+    printf("Failed to create directory: %s\n", outDirectory.c_str());
+    return false;
+  }
+
+  printf("Searching %s of %s between %g and %g for %g at confidence %s\n", mParameter.c_str(), level.c_str(), mLow, mHigh, mTarget, confidence.c_str());
+
+  for (double value : {mLow, mHigh})
+  {
+    Point* point = AddPoint(value);
+    RETURN_ON_FAILURE(point);
+    point->pending = batches;
+  }
+
+  printf("%-12s %8s %10s %10s\n", "value", "batches", "mean", "std err");
+
+  float z = 0.0;
+  bool located = false;
+  double low = mLow;
+  double high = mHigh;
+  while (true)
+  {
+    std::vector<Point*> simulated;
+    for (auto& point : mPoints)
+    {
+      if (point->pending > 0)
+        simulated.push_back(point.get());
+    }
+
+    RETURN_ON_FAILURE(Simulate(args, cache));
+
+    for (const auto* point : simulated)
+    {
+      auto stats = point->stats->GetStats();
+      printf("%-12s %8u %10.6f %10.6f\n", PointName(*point).c_str(), point->stats->Batches(), stats.mean, std::sqrt(stats.variance / stats.count));
+    }
+
+    if (mDirection == 0)
+    {
+      bool increasing = mPoints.back()->stats->GetStats().mean >= mPoints.front()->stats->GetStats().mean;
+      mDirection = increasing ? 1 : -1;
+    }
+
+    if (z == 0.0)
+      RETURN_ON_FAILURE(mPoints.front()->stats->ZValue(confidence, z));
+
+    Fit(z);
+
+    // The ends are past the target, or not there yet, on their own
+    if (mPoints.front()->side > 0 || mPoints.back()->side < 0)
+      break;
+
+    // Closest values known to lie on either side of the target
+    low = mLow;
+    high = mHigh;
+    bool lowKnown = false;
+    bool highKnown = false;
+    for (const auto& point : mPoints)
+    {
+      if (point->side < 0)
+      {
+        low = point->value;
+        lowKnown = true;
+      }
+
+      if (point->side > 0 && !highKnown)
+      {
+        high = point->value;
+        highKnown = true;
+      }
+    }
+
+    if (lowKnown && highKnown && high - low <= mTolerance * (1 + 1e-6))
+    {
+      located = true;
+      break;
+    }
+
+    // A new value where the model crosses the target, unless one close
+    // enough to it has been simulated already
+    double crossing = std::min(std::max(Crossing(), low), high);
+    double value = mInteger ? std::round(crossing) : crossing;
+    if (mInteger)
+      value = std::min(std::max(value, low + 1), high - 1);
+
+    double spacing = mInteger ? 0.5 : mTolerance / 2;
+    bool fresh = value > low && value < high;
+    for (const auto& point : mPoints)
+      fresh = fresh && std::abs(point->value - value) >= spacing;
+
+    if (fresh)
+    {
+      Point* point = AddPoint(value);
+      RETURN_ON_FAILURE(point);
+      point->pending = batches;
+      continue;
+    }
+
+    // Otherwise the point closest to the crossing needs a narrower interval
+    Point* closest = nullptr;
+    for (const auto& point : mPoints)
+    {
+      if (point->side != 0 || point->value < low || point->value > high || point->stats->Batches() >= maxBatches)
+        continue;
+
+      if (!closest || std::abs(point->value - crossing) < std::abs(closest->value - crossing))
+        closest = point.get();
+    }
+
+    if (!closest)
+      break;
+
+    closest->pending = std::min(closest->stats->Batches(), maxBatches - closest->stats->Batches());
+  }
+
+  printf("\n%-12s %8s %10s %10s %10s %8s\n", "value", "batches", "mean", "std err", "model", "target");
+
+  uint32_t total = 0;
+  for (const auto& point : mPoints)
+  {
+    std::string name = PointName(*point);
+    RETURN_ON_FAILURE(point->stats->Save(directory + level + "_" + name + ".txt"));
+
+    auto stats = point->stats->GetStats();
+    int32_t side = point->side * mDirection;
+    const char* relation = side < 0 ? "below" : (side > 0 ? "above" : "?");
+    printf("%-12s %8u %10.6f %10.6f %10.6f %8s\n", name.c_str(), point->stats->Batches(), stats.mean, std::sqrt(stats.variance / stats.count),
+        mDirection * point->fitted, relation);
+
+    total += point->stats->Batches();
+  }
+
+  printf("Simulated %u batches over %zu values\n", total, mPoints.size());
+
+  if (located)
+    printf("The target %g is crossed between %g and %g, the model puts it at %g\n", mTarget, low, high, Crossing());
+  else if (mPoints.front()->side > 0)
+    printf("The estimate is already past the target %g at %g\n", mTarget, mLow);
+  else if (mPoints.back()->side < 0)
+    printf("The estimate does not reach the target %g by %g\n", mTarget, mHigh);
+  else
+    printf("The target %g is crossed between %g and %g, but the values in between cannot be told apart from it with %u batches, the model puts it at %g\n",
+        mTarget, low, high, maxBatches, Crossing());
+
+  return true;
+}
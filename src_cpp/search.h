@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "blueprint.h"
+#include "result_cache.h"
+#include "settings.h"
+#include "statistics.h"
+
+// Finds the value of one level parameter where the estimate of the test
+// crosses a target, e.g. the number of guards which brings q below 0.3,
+// without simulating every value of the range:
+//
+//   { "config": "../verified/level_2_q.json",
+//     "parameter": "guards/number_of_guards",
+//     "range": [1, 12],
+//     "integer": true,
+//     "target": 0.3 }
+//
+// The estimate is assumed to move in one direction over the range, so an
+// isotonic regression of every point simulated so far, weighted by how
+// precise each point is, serves as a cheap model of it. Every round either
+// simulates a new value where the model crosses the target, or doubles the
+// batches of the point closest to it whose confidence interval still holds
+// the target. The search ends once two values closer than "tolerance"
+// (1 for integers) are known to lie on either side of the target.
+//
+// Optional keys: "tolerance", "max_batches" per point (16 times -b by
+// default), "increasing" to fix the direction instead of taking it from the
+// ends of the range, and "name" like in sweep files.
+class Search
+{
+public:
+  Search();
+  ~Search();
+
+  bool Init(const std::string& searchFile);
+
+  // Simulate rounds of -b batches until the crossing is located at
+  // confidence, every point is saved like a sweep point
+  bool Run(const Args& args, const std::string& confidence, const std::string& outDirectory, const ResultCache* cache = nullptr);
+
+private:
+  struct Point
+  {
+    double value = 0.0;
+    nlohmann::json config;
+    Blueprint blueprint;
+    std::string cacheKey;
+
+    std::unique_ptr<Statistics> stats;
+    uint32_t pending = 0;  // Batches to simulate in the next round
+
+    // Of the model, in the direction where the estimate increases
+    float fitted = 0.0;
+    float halfWidth = 0.0;
+    int32_t side = 0;  // -1 before the target, 1 past it, 0 not known yet
+  };
+
+  std::string mConfigFile;
+  std::string mName;
+  nlohmann::json mConfig;
+  Blueprint mBase;
+
+  std::string mParameter;
+  double mLow;
+  double mHigh;
+  bool mInteger;
+  double mTolerance;
+  float mTarget;
+  uint32_t mMaxBatches;
+  int32_t mDirection;  // 1 if the estimate increases with the value, -1 if it decreases, 0 unknown
+
+  std::vector<std::unique_ptr<Point>> mPoints;  // Sorted by value
+
+  Point* AddPoint(double value);
+
+  // Simulate the pending batches of every point
+  bool Simulate(const Args& args, const ResultCache* cache);
+
+  // Fit the model at z and classify every point
+  void Fit(float z);
+
+  // Value where the model crosses the target
+  double Crossing() const;
+
+  std::string PointName(const Point& point) const;
+};
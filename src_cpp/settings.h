@@ -1,17 +1,8 @@
 #pragma once
 #include <stdint.h>
-#include <SDL2/SDL.h>
-
-extern uint32_t FPS;
-extern uint32_t CYCLES_PER_FRAME;
-extern uint32_t DAY_LENGTH;
-
-extern uint32_t WIDTH;
-extern uint32_t HEIGHT;
-extern uint32_t TILE_SIZE;
-extern uint32_t HALF_TILE;
-
-extern bool HIDDEN;
+#include <cfloat>
+#include <string>
+#include <vector>
 
 struct Point
 {
@@ -36,6 +27,15 @@ struct Point
   float y = 0;
 };
 
+// Area in pixels, laid out like SDL_Rect
+struct Rect
+{
+  int x = 0;
+  int y = 0;
+  int w = 0;
+  int h = 0;
+};
+
 struct Line
 {
   Line() {}
@@ -56,7 +56,7 @@ struct Line
   float b = 0.0;
   float c = 0.0;
 
-  SDL_Rect deadzone;
+  Rect deadzone;
 };
 
 class Cost
@@ -97,6 +97,31 @@ struct Color
   uint8_t b;
 };
 
+// Values every part of one simulation reads. Each simulation keeps its own
+// copy, so simulations of different levels can run side by side.
+struct Settings
+{
+  uint32_t fps = 0;
+  uint32_t cyclesPerFrame = 0;
+  uint32_t dayLength = 0;
+
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t tileSize = 0;
+  uint32_t halfTile = 0;
+
+  // Ticks simulated by every update, 1 reproduces the original game exactly
+  uint32_t timeStep = 1;
+
+  bool hidden = false;
+
+  // Random sequences of entities are numbered within their kind
+  bool commonRandom = false;
+
+  // Every odd iteration mirrors the random sequences of the one before
+  bool antithetic = false;
+};
+
 struct Args
 {
   uint32_t fps = 0;
@@ -104,8 +129,42 @@ struct Args
   uint32_t batches = 1;
   uint32_t iterations = 1;
 
+  // Seconds to keep simulating batches for instead of a fixed number of them
+  float timeBudget = 0;
+
+  // Stop before the last batch once the interval at confidence is at most
+  // this wide on either side of the mean, 0 runs every batch
+  float targetHalfWidth = 0;
+  std::string confidence = "0.75";
+
+  // Every random number of a run follows from it
+  uint64_t seed = 0;
+  uint32_t threads = 1;
+  uint32_t tickThreads = 1;
+
+  // Only batches [batches * shard / shards, batches * (shard + 1) / shards) are run
+  uint32_t shard = 0;
+  uint32_t shards = 1;
+
+  uint32_t timeStep = 1;
+  uint32_t replicas = 1;
+
+  // Distances to an open door, in tiles, where iterations are split
+  std::vector<float> splitLevels;
+  uint32_t splitFactor = 2;
+
   bool hidden = false;
 
+  // Variance reduction, see Settings
+  bool commonRandom = false;
+  bool antithetic = false;
+
+  // Keep every sample of a batch, not just their running mean and variance
+  bool keepSamples = false;
+
+  // Replays of the iterations of batch n are written to <record>batch_<n>.replay
+  std::string record;
+
   float value = FLT_MAX;
   std::string parameter;
   std::string entity;
@@ -116,4 +175,12 @@ struct Result
   bool success = false;
   float ticksElapsed = 0;
   DoorStats doorStats;
+};
+
+// Outcome of one branch of a split iteration, the weights of all
+// branches of an iteration add up to one
+struct WeightedResult
+{
+  Result result;
+  float weight = 1.0;
 };
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "simulation.h"
+
+#include <stdio.h>
+#include <chrono>
+
+#include "allocations.h"
+#include "helpers.h"
+#include "settings.h"
+
+Simulation::Simulation(const Blueprint& blueprint, uint32_t batch)
+    : mRun(true)
+    , mResult(false)
+    , mBlueprint(blueprint)
+    , mBatch(batch)
+    , mBatchKey(0)
+    , mIteration(0)
+    , mTicks(0)
+    , mTotalTicks(0)
+    , mReplicasDone(0)
+    , mTickAllocations(0)
+    , mMeasure(false)
+    , mUnmeasured(0)
+{
+}
+
+Simulation::~Simulation()
+{
+}
+
+bool Simulation::Init(Args overrides)
+{
+  if (mLevel)
+  {
+    printf("Simulation already initialised\n");
+    return true;
+  }
+
+  RETURN_ON_FAILURE(SetupSettings(overrides));
+
+  mMeasure = MetricsEnabled();
+
+  mBatchKey = Randomizer::Key(overrides.seed, mBatch);
+
+  bool isBuilding = !mBlueprint.floors.empty();
+  if (isBuilding && (overrides.replicas > 1 || !overrides.splitLevels.empty()))
+  {
+    printf("Ignoring --replicas and --split-at, they cannot be used with buildings\n");
+    overrides.replicas = 1;
+    overrides.splitLevels.clear();
+  }
+
+  // Their iterations do not go through Level::ReseedIteration
+  if (overrides.antithetic && (isBuilding || !overrides.splitLevels.empty()))
+  {
+    printf("Ignoring --antithetic, it cannot be used with buildings or --split-at\n");
+    mSettings.antithetic = false;
+  }
+
+  // Replicas live in the regular level, the other runners build their own
+  mReplicaResults.resize(std::max<uint32_t>(overrides.replicas, 1));
+  if (mReplicaResults.size() > 1 && !overrides.splitLevels.empty())
+  {
+    printf("Ignoring --split-at, it cannot be combined with --replicas\n");
+    overrides.splitLevels.clear();
+  }
+
+  // Entities are created once and reused by every iteration
+  RETURN_ON_FAILURE(SetupLevel());
+
+  // The frontend only draws between ticks, so ticks can always be split
+  if (overrides.tickThreads > 1)
+  {
+    mPool = std::make_unique<ThreadPool>(overrides.tickThreads);
+    mLevel->SetThreadPool(mPool.get());
+  }
+
+  if (isBuilding)
+  {
+    // Only a single level can be displayed
+    LOG_AND_RETURN_ON_FAILURE(mSettings.hidden, "Buildings can only be simulated with --hidden");
+
+    mBuilding = std::make_unique<Building>(mBlueprint, mSettings);
+    RETURN_ON_FAILURE(mBuilding->Init(mPool.get()));
+  }
+
+  if (!overrides.splitLevels.empty())
+  {
+    if (mSettings.hidden)
+    {
+      mSplitting = std::make_unique<Splitting>(mBlueprint, mSettings, overrides.splitLevels, overrides.splitFactor);
+      RETURN_ON_FAILURE(mSplitting->Init(mPool.get()));
+    }
+    else
+    {
+      printf("Ignoring --split-at, it requires --hidden\n");
+    }
+  }
+
+  if (!overrides.record.empty())
+  {
+    // Only the plain runner goes through the ticks of a single level
+    if (mBuilding || mSplitting || mReplicaResults.size() > 1)
+    {
+      printf("Ignoring --record, it cannot be combined with buildings, --split-at or --replicas\n");
+    }
+    else
+    {
+      mRecorder = std::make_unique<Recorder>(overrides.record + "batch_" + std::to_string(mBatch) + ".replay");
+      RETURN_ON_FAILURE(mRecorder->Init(mBlueprint.level, *mLevel, mSettings, mTotalTicks));
+    }
+  }
+
+  return Reset();
+}
+
+bool Simulation::SetupSettings(Args overrides)
+{
+  mSettings.fps            = overrides.fps > 0 ? overrides.fps : mBlueprint.fps;
+  mSettings.cyclesPerFrame = overrides.cycles > 0 ? overrides.cycles : mBlueprint.cyclesPerFrame;
+  mSettings.dayLength      = mBlueprint.dayDuration;
+
+  mSettings.tileSize       = mBlueprint.tileSize;
+  mSettings.halfTile       = mSettings.tileSize / 2;
+
+  mSettings.width = mBlueprint.width;
+  mSettings.height = mBlueprint.height;
+
+  mSettings.hidden = overrides.hidden;
+  mSettings.timeStep = overrides.timeStep > 0 ? overrides.timeStep : 1;
+
+  mSettings.commonRandom = overrides.commonRandom;
+  mSettings.antithetic = overrides.antithetic;
+
+  mTotalTicks = mSettings.dayLength * 60 * 60;
+
+  return true;
+}
+
+bool Simulation::SetupLevel()
+{
+  mLevel = std::make_unique<Level>(mSettings);
+  mLevel->mReachedDoor = [this]{ Finished(true); };
+  mLevel->mWasCaught = [this]{ Finished(false); };
+  mLevel->mReplicaFinished = [this](uint32_t replica, bool result){ ReplicaFinished(replica, result); };
+
+  return mLevel->Init(mBlueprint, mReplicaResults.size());
+}
+
+bool Simulation::Reset()
+{
+  mRun = true;
+  mResult = false;
+  mTicks = 0;
+
+  mReplicasDone = 0;
+  mReplicaDone.assign(mReplicaResults.size(), 0);
+
+  // Prepare the next iteration, Run counts it once it starts
+  mLevel->ReseedIteration(mBatchKey, mIteration);
+  return mLevel->Reset();
+}
+
+bool Simulation::Run()
+{
+  ++mIteration;
+  mTickAllocations = 0;
+
+  if (mRecorder)
+    mRecorder->Begin(mIteration - 1, *mLevel);
+
+  bool running = true;
+  while (running && !IsDone())
+  {
+    for (uint32_t i = 0; !IsDone() && i < mSettings.cyclesPerFrame; ++i)
+    {
+      if (IsDayDone())
+      {
+        Finished(true);
+        break;
+      }
+
+      bool measured = mMeasure && ++mUnmeasured == METRICS_SAMPLING;
+
+      uint64_t allocations = AllocationCount();
+      if (measured)
+        MeasuredTick();
+      else
+        mLevel->Run();
+      mTickAllocations += AllocationCount() - allocations;
+
+      mTicks += mSettings.timeStep;
+
+      if (mRecorder)
+      {
+        auto start = std::chrono::steady_clock::now();
+        mRecorder->Tick(mTicks, *mLevel);
+        if (measured)
+          mMetrics.nanoseconds[SUBSYSTEM_RECORDING] += std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+      }
+    }
+
+    if (mFrame && !mFrame())
+    {
+      Finished(false);
+      running = false;  // Return false to prevent future runs
+    }
+  }
+
+  if (mRecorder)
+    mRecorder->End(mTicks, GetResult());
+
+  return running;
+}
+void Simulation::MeasuredTick()
+{
+  mUnmeasured = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  mLevel->UpdateCrowd();
+  auto crowd = std::chrono::steady_clock::now();
+  mLevel->UpdateDoors();
+  auto doors = std::chrono::steady_clock::now();
+  mLevel->UpdateAttacker();
+  auto attacker = std::chrono::steady_clock::now();
+
+  mMetrics.nanoseconds[SUBSYSTEM_CROWD] += std::chrono::nanoseconds(crowd - start).count();
+  mMetrics.nanoseconds[SUBSYSTEM_DOORS] += std::chrono::nanoseconds(doors - crowd).count();
+  mMetrics.nanoseconds[SUBSYSTEM_ATTACKER] += std::chrono::nanoseconds(attacker - doors).count();
+}
+
+void Simulation::Count(uint32_t iterations, float ticks)
+{
+  if (!mMeasure)
+    return;
+
+  mMetrics.iterations += iterations;
+  mMetrics.ticks += uint64_t(ticks);
+  ReportMetrics(mMetrics);
+  mMetrics = RunMetrics();
+}
+
+void Simulation::Finished(bool result)
+{
+  mRun = false;
+  mResult = result;
+}
+
+void Simulation::ReplicaFinished(uint32_t replica, bool result)
+{
+  // Called from within the tick, which is already over for this replica
+  mReplicaResults[replica] = Result{result, float(mTicks + mSettings.timeStep) / 60, mLevel->GetResult(replica)};
+  mReplicaDone[replica] = 1;
+
+  if (++mReplicasDone == mReplicaResults.size())
+    Finished(result);
+}
+
+Result Simulation::GetResult()
+{
+  return Result{mResult, float(mTicks) / 60, mLevel->GetResult()};
+}
+
+uint64_t Simulation::TickAllocations() const
+{
+  return mTickAllocations;
+}
+
+uint32_t Simulation::Replicas() const
+{
+  return mReplicaResults.size();
+}
+
+std::vector<Result> Simulation::GetReplicaResults()
+{
+  // Replicas still around at the end of the day made it
+  for (uint32_t i = 0; i < mReplicaResults.size(); ++i)
+  {
+    if (!mReplicaDone[i])
+      mReplicaResults[i] = Result{true, float(mTicks) / 60, mLevel->GetResult(i)};
+  }
+
+  return mReplicaResults;
+}
+
+bool Simulation::HasFloors() const
+{
+  return mBuilding != nullptr;
+}
+
+Result Simulation::RunBuilding()
+{
+  if (!mBuilding)
+    return Result();
+
+  return mBuilding->Run(mTotalTicks, Randomizer::Key(mBatchKey, mIteration++));
+}
+
+bool Simulation::Splits() const
+{
+  return mSplitting != nullptr;
+}
+
+std::vector<WeightedResult> Simulation::RunSplit()
+{
+  if (!mSplitting)
+    return std::vector<WeightedResult>();
+
+  return mSplitting->Run(mTotalTicks, Randomizer::Key(mBatchKey, mIteration++));
+}
+
+bool Simulation::RunBatch(uint32_t iterations, Statistics& stats)
+{
+  bool running = true;
+
+  stats.NewBatch();
+  for (uint32_t j = 0; running && j < iterations;)
+  {
+    // The runners below never call mFrame, so they can only be stopped
+    // between iterations
+    if (HasFloors())
+    {
+      Result result = RunBuilding();
+      stats.UpdateStats(j++, result);
+      Count(1, result.ticksElapsed * 60);
+      running = !mFrame || mFrame();
+      continue;
+    }
+
+    if (Replicas() > 1)
+    {
+      running = Run();
+      stats.UpdateReplicas(j++, GetReplicaResults());
+      Count(1, mTicks);
+      Reset();
+      continue;
+    }
+
+    if (Splits())
+    {
+      stats.UpdateStats(j++, RunSplit());
+      Count(1, mSplitting->Ticks());
+      running = !mFrame || mFrame();
+      continue;
+    }
+
+    running = Run();
+    stats.UpdateStats(j++, GetResult());
+    Count(1, mTicks);
+    Reset();
+  }
+
+  return running;
+}
+
+const Settings& Simulation::GetSettings() const
+{
+  return mSettings;
+}
+
+const Level& Simulation::GetLevel() const
+{
+  return *mLevel;
+}
+
+uint32_t Simulation::Ticks() const
+{
+  return mTicks;
+}
+
+uint32_t Simulation::TotalTicks() const
+{
+  return mTotalTicks;
+}
+
+bool Simulation::IsDone() const
+{
+  return !mRun;
+}
+
+bool Simulation::IsDayDone() const
+{
+  return mTicks >= mTotalTicks;
+}
\ No newline at end of file
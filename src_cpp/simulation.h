@@ -0,0 +1,108 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "blueprint.h"
+#include "building.h"
+#include "level.h"
+#include "metrics.h"
+#include "replay.h"
+#include "splitting.h"
+#include "statistics.h"
+#include "thread_pool.h"
+
+// Everything needed to simulate iterations of a level, without any display.
+// The SDL frontend in game.h shows a simulation through mFrame.
+class Simulation
+{
+public:
+  // Random numbers depend only on the seed, the batch and the iteration
+  Simulation(const Blueprint& blueprint, uint32_t batch = 0);
+  ~Simulation();
+
+  bool Init(Args overrides);
+
+  // Simulate one iteration, false if the frontend asked to stop
+  bool Run();
+
+  bool Reset();
+
+  // Simulate iterations into a new batch of stats with whichever runner is
+  // set up, false if the frontend asked to stop
+  bool RunBatch(uint32_t iterations, Statistics& stats);
+
+  Result GetResult();
+
+  // Calls to the global allocator made by the ticks of the last Run,
+  // see allocations.h
+  uint64_t TickAllocations() const;
+
+  // Number of attacker replicas sharing every iteration, their results
+  // replace GetResult and are only complete once Run returned
+  uint32_t Replicas() const;
+  std::vector<Result> GetReplicaResults();
+
+  // True for buildings, RunBuilding then replaces Run
+  bool HasFloors() const;
+  Result RunBuilding();
+
+  // True if iterations are split, RunSplit then replaces Run
+  bool Splits() const;
+  std::vector<WeightedResult> RunSplit();
+
+  const Settings& GetSettings() const;
+  const Level& GetLevel() const;
+
+  uint32_t Ticks() const;
+  uint32_t TotalTicks() const;
+
+  // Called by Run after every cyclesPerFrame updates, returning false stops the run
+  std::function<bool()> mFrame;
+
+private:
+  bool mRun;
+  bool mResult;
+
+  const Blueprint& mBlueprint;
+  Settings mSettings;
+
+  const uint32_t mBatch;
+  uint64_t mBatchKey;
+  uint32_t mIteration;   // Iterations started so far
+
+  std::unique_ptr<Level> mLevel;
+  std::unique_ptr<ThreadPool> mPool;
+  std::unique_ptr<Splitting> mSplitting;
+  std::unique_ptr<Building> mBuilding;
+  std::unique_ptr<Recorder> mRecorder;
+
+  uint32_t mTicks;
+  uint32_t mTotalTicks;
+
+  std::vector<Result> mReplicaResults;
+  std::vector<uint8_t> mReplicaDone;
+  uint32_t mReplicasDone;
+
+  uint64_t mTickAllocations;
+
+  // Only collected while metrics are exported, see metrics.h
+  bool mMeasure;
+  uint32_t mUnmeasured;  // Ticks since the last sampled one
+  RunMetrics mMetrics;
+
+  bool SetupSettings(Args overrides);
+  bool SetupLevel();
+
+  // Level::Run with the time of every subsystem added to mMetrics
+  void MeasuredTick();
+
+  // Report iterations of a batch, which simulated ticks between them
+  void Count(uint32_t iterations, float ticks);
+
+  void Finished(bool result);
+  void ReplicaFinished(uint32_t replica, bool result);
+  bool IsDayDone() const;
+  bool IsDone() const;
+};
@@ -0,0 +1,77 @@
+#include "snapshot.h"
+
+void Snapshot::Capture(const Level& level, uint32_t ticks, uint32_t totalTicks)
+{
+  movables.clear();
+  attackers.clear();
+  paths.clear();
+  doors.clear();
+
+  for (const auto& guard : level.Guards())
+    Add(*guard, movables);
+
+  for (const auto& employee : level.Employees())
+    Add(*employee, movables);
+
+  for (const auto& attacker : level.Attackers())
+  {
+    if (attacker->IsPresent())
+      Add(*attacker, attackers);
+  }
+
+  for (const auto& door : level.Doors())
+    doors.push_back(DoorState{door->Area(), door->IsOpen()});
+
+  this->ticks = ticks;
+  this->totalTicks = totalTicks;
+}
+
+void Snapshot::Add(const Movable& movable, std::vector<Body>& bodies)
+{
+  Body body;
+  body.x = movable.X();
+  body.y = movable.Y();
+  body.color = movable.GetColor();
+  body.checking = movable.IsChecking();
+
+  body.pathBegin = paths.size();
+  const auto& path = movable.Path();
+  paths.insert(paths.end(), path.begin(), path.end());
+  body.pathEnd = paths.size();
+
+  bodies.push_back(body);
+}
+
+SnapshotBuffer::SnapshotBuffer()
+    : mBack(0)
+    , mFront(1)
+    , mSpare(2)
+{
+}
+
+Snapshot& SnapshotBuffer::Back()
+{
+  return mSlots[mBack];
+}
+
+void SnapshotBuffer::Publish()
+{
+  // Release makes the snapshot visible to the reader that acquires the slot
+  uint8_t previous = mSpare.exchange(mBack | FRESH, std::memory_order_acq_rel);
+  mBack = previous & ~FRESH;
+}
+
+bool SnapshotBuffer::Update()
+{
+  if (!(mSpare.load(std::memory_order_relaxed) & FRESH))
+    return false;
+
+  uint8_t previous = mSpare.exchange(mFront, std::memory_order_acq_rel);
+  mFront = previous & ~FRESH;
+  return true;
+}
+
+const Snapshot& SnapshotBuffer::Front() const
+{
+  return mSlots[mFront];
+}
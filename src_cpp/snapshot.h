@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "level.h"
+#include "settings.h"
+
+// Everything the display draws of a level at one moment, copied out of the
+// level between ticks so it can be drawn on another thread while the
+// simulation carries on. Capturing reuses the vectors, so once they have
+// grown it does not allocate.
+struct Snapshot
+{
+  struct Body
+  {
+    float x = 0;
+    float y = 0;
+    Color color = {0, 0, 0};
+    bool checking = false;
+
+    // Range of the path still to be walked in paths
+    uint32_t pathBegin = 0;
+    uint32_t pathEnd = 0;
+  };
+
+  struct DoorState
+  {
+    Rect area = {0, 0, 0, 0};
+    bool open = false;
+  };
+
+  std::vector<Body> movables;   // Guards and employees
+  std::vector<Body> attackers;  // Only those present
+  std::vector<Point> paths;
+  std::vector<DoorState> doors;
+
+  uint32_t ticks = 0;
+  uint32_t totalTicks = 0;
+
+  void Capture(const Level& level, uint32_t ticks, uint32_t totalTicks);
+
+private:
+  void Add(const Movable& movable, std::vector<Body>& bodies);
+};
+
+// Hands the latest snapshot from the simulation thread to the render thread
+// without locks. Writer and reader each own a slot, the third one is
+// exchanged atomically, so neither ever waits for the other and the reader
+// always gets the most recent complete snapshot.
+class SnapshotBuffer
+{
+public:
+  SnapshotBuffer();
+
+  // Writer side, fill Back() and then Publish() it
+  Snapshot& Back();
+  void Publish();
+
+  // Reader side, true if a newer snapshot was published since the last call.
+  // Front() stays valid until the next call
+  bool Update();
+  const Snapshot& Front() const;
+
+private:
+  static const uint8_t FRESH = 4;
+
+  Snapshot mSlots[3];
+  uint8_t mBack;
+  uint8_t mFront;
+
+  // Index of the spare slot, with FRESH set while the reader has not taken it
+  std::atomic<uint8_t> mSpare;
+};
@@ -0,0 +1,118 @@
+#include "splitting.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "helpers.h"
+
+Splitting::Splitting(const Blueprint& blueprint, const Settings& settings, const std::vector<float>& thresholds, uint32_t factor)
+    : mBlueprint(blueprint)
+    , mSettings(settings)
+    , mThresholds(thresholds)
+    , mFactor(std::max<uint32_t>(factor, 1))
+    , mRunning(false)
+    , mResult(false)
+    , mTicks(0)
+{
+  std::sort(mThresholds.begin(), mThresholds.end(), std::greater<float>());
+}
+
+Splitting::~Splitting()
+{
+}
+
+bool Splitting::Init(ThreadPool* pool)
+{
+  mLevel = std::make_unique<Level>(mSettings);
+  mLevel->mReachedDoor = [this]{ Finished(true); };
+  mLevel->mWasCaught = [this]{ Finished(false); };
+
+  LOG_AND_RETURN_ON_FAILURE(mLevel->Init(mBlueprint), "Failed to create splitting level");
+  mLevel->SetThreadPool(pool);
+
+  return true;
+}
+
+uint64_t Splitting::Ticks() const
+{
+  return mTicks;
+}
+
+void Splitting::Finished(bool result)
+{
+  mRunning = false;
+  mResult = result;
+}
+
+uint32_t Splitting::Stage() const
+{
+  float distance = mLevel->DistanceToOpenDoor();
+
+  uint32_t stage = 0;
+  while (stage < mThresholds.size() && distance <= mThresholds[stage])
+    ++stage;
+
+  return stage;
+}
+
+std::vector<WeightedResult> Splitting::Run(uint32_t totalTicks, uint64_t key)
+{
+  std::vector<WeightedResult> results;
+  std::vector<Branch> pending;
+
+  mLevel->Reseed(key);
+  mLevel->Reset();
+  Branch branch;
+  uint64_t branches = 0;
+  mTicks = 0;
+
+  while (true)
+  {
+    mRunning = true;
+    mResult = false;
+
+    while (mRunning)
+    {
+      if (branch.ticks >= totalTicks)
+      {
+        Finished(true);
+        break;
+      }
+
+      mLevel->Run();
+      branch.ticks += mSettings.timeStep;
+      mTicks += mSettings.timeStep;
+
+      uint32_t stage = Stage();
+      if (!mRunning || stage <= branch.stage)
+        continue;
+
+      // Continue factor times per stage reached, this branch being one of them
+      uint32_t copies = std::pow(mFactor, stage - branch.stage);
+      branch.weight /= copies;
+      branch.stage = stage;
+
+      if (copies == 1)
+        continue;
+
+      auto snapshot = std::make_shared<LevelSnapshot>();
+      mLevel->Save(*snapshot);
+      for (uint32_t i = 1; i < copies; ++i)
+        pending.push_back(Branch{snapshot, branch.ticks, branch.stage, branch.weight});
+    }
+
+    results.push_back(WeightedResult{Result{mResult, float(branch.ticks) / 60, mLevel->GetResult()}, branch.weight});
+
+    if (pending.empty())
+      break;
+
+    // Without new seeds the branch would repeat the one just finished
+    branch = pending.back();
+    pending.pop_back();
+
+    mLevel->Restore(*branch.snapshot);
+    mLevel->Reseed(Randomizer::Key(key, ++branches));
+  }
+
+  return results;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "blueprint.h"
+#include "level.h"
+#include "settings.h"
+#include "thread_pool.h"
+
+// Multilevel splitting for configurations where the attacker rarely gets in.
+// The distance between the attacker and the closest open door is cut into
+// stages by the given thresholds. Whenever an iteration reaches a stage it
+// has not reached before, the level is stored and the iteration continues
+// factor times from there, each branch carrying 1/factor of its weight and
+// a fresh random sequence. The weights of all branches of an iteration add
+// up to one, so weighted statistics keep the plain Monte Carlo expectation
+// while many more of the simulated ticks are spent close to the doors.
+class Splitting
+{
+public:
+  Splitting(const Blueprint& blueprint, const Settings& settings, const std::vector<float>& thresholds, uint32_t factor);
+  ~Splitting();
+
+  bool Init(ThreadPool* pool);
+
+  // Simulate the iteration given by key, returns every branch it was split into
+  std::vector<WeightedResult> Run(uint32_t totalTicks, uint64_t key);
+
+  // Ticks simulated by the last Run over all of its branches
+  uint64_t Ticks() const;
+
+private:
+  struct Branch
+  {
+    std::shared_ptr<const LevelSnapshot> snapshot;
+    uint32_t ticks = 0;
+    uint32_t stage = 0;
+    float weight = 1.0;
+  };
+
+  const Blueprint& mBlueprint;
+  const Settings mSettings;
+
+  std::vector<float> mThresholds;  // Sorted from far to close
+  uint32_t mFactor;
+
+  std::unique_ptr<Level> mLevel;
+
+  bool mRunning;
+  bool mResult;
+  uint64_t mTicks;
+
+  uint32_t Stage() const;
+  void Finished(bool result);
+};
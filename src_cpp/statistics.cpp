@@ -3,15 +3,19 @@
 #include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <iostream>
 
 #include <stdio.h>
 
 #include "helpers.h"
 
-Statistics::Statistics(const std::string& type, uint32_t batches, uint32_t iterations)
-    : mBatches(batches)
+Statistics::Statistics(const std::string& type, uint32_t dayLength, uint32_t batches, uint32_t iterations)
+    : mDayLength(dayLength)
+    , mBatches(batches)
     , mBatchIndex(-1)
     , mIterations(iterations)
+    , mKeepSamples(false)
+    , mClosed(0)
 {
   mType = type == "q-test" ? TestType::Q_TEST : TestType::P_TEST;
   mStart = std::chrono::system_clock::now();
@@ -23,24 +27,127 @@ Statistics::~Statistics()
 }
 
 void Statistics::UpdateStats(uint32_t iteration, Result result)
+{
+  UpdateStats(iteration, std::vector<WeightedResult>{ WeightedResult{result, 1.0} });
+}
+
+void Statistics::UpdateStats(uint32_t iteration, const std::vector<WeightedResult>& branches)
+{
+  auto& stat = *mStats[mBatchIndex];
+  float ticksElapsed = 0.0;
+  float entered = 0.0;
+  float attempts = 0.0;
+
+  for (const auto& branch : branches)
+  {
+    Add(stat, branch.result, branch.weight);
+    ticksElapsed += branch.weight * branch.result.ticksElapsed;
+    entered += branch.weight * branch.result.doorStats.successes;
+    attempts += branch.weight * (branch.result.doorStats.successes + branch.result.doorStats.failures);
+  }
+
+  float q = ticksElapsed / float(mDayLength * 60);
+  AddSamples(stat, PValue(stat), q);
+  AddOutcome(stat, iteration, mType == TestType::Q_TEST ? q : (attempts > 0 ? entered / attempts : 0.0f));
+}
+
+void Statistics::UpdateReplicas(uint32_t iteration, const std::vector<Result>& replicas)
+{
+  auto& stat = *mStats[mBatchIndex];
+  stat.replicas.resize(replicas.size());
+
+  // Replicas share the rest of the level, so only their average
+  // is an independent sample, while door attempts simply add up
+  float ticksElapsed = 0.0;
+  float entered = 0.0;
+  float attempts = 0.0;
+  for (uint32_t i = 0; i < replicas.size(); ++i)
+  {
+    auto& replica = stat.replicas[i];
+    Add(replica, replicas[i], 1.0);
+    AddSamples(replica, PValue(replica), replicas[i].ticksElapsed / float(mDayLength * 60));
+
+    Add(stat, replicas[i], 1.0);
+    ticksElapsed += replicas[i].ticksElapsed / replicas.size();
+    entered += replicas[i].doorStats.successes;
+    attempts += replicas[i].doorStats.successes + replicas[i].doorStats.failures;
+  }
+
+  float q = ticksElapsed / float(mDayLength * 60);
+  AddSamples(stat, PValue(stat), q);
+  AddOutcome(stat, iteration, mType == TestType::Q_TEST ? q : (attempts > 0 ? entered / attempts : 0.0f));
+}
+
+void Statistics::AddSamples(GameStats& stat, float p, float q) const
+{
+  stat.p.Add(p);
+  stat.q.Add(q);
+
+  if (mKeepSamples)
+  {
+    stat.pSamples.push_back(p);
+    stat.qSamples.push_back(q);
+  }
+}
+
+void Statistics::AddOutcome(GameStats& stat, uint32_t iteration, float outcome) const
+{
+  stat.outcomes.Add(outcome);
+
+  if (iteration % 2 == 0)
+    stat.firstOfPair = outcome;
+  else
+    stat.pairs.Add((stat.firstOfPair + outcome) / 2);
+}
+
+void Statistics::Add(GameStats& stat, const Result& result, float weight) const
 {
   if (result.success)
-    ++(mStats[mBatchIndex]->wins);
+    stat.wins += weight;
   else
-    ++(mStats[mBatchIndex]->losses);
+    stat.losses += weight;
 
-  mStats[mBatchIndex]->doorsEntered += float(result.doorStats.successes);
-  mStats[mBatchIndex]->doorsBlocked += float(result.doorStats.failures);
+  stat.doorsEntered += weight * float(result.doorStats.successes);
+  stat.doorsBlocked += weight * float(result.doorStats.failures);
+}
 
-  mStats[mBatchIndex]->pSamples.push_back(PValue(*mStats[mBatchIndex]));
-  mStats[mBatchIndex]->qSamples.push_back(result.ticksElapsed / float(DAY_LENGTH * 60));
+void Statistics::KeepSamples(bool keep)
+{
+  mKeepSamples = keep;
 }
 
 void Statistics::NewBatch()
 {
   ++mBatchIndex;
-  GameStats stat;
   mStats.push_back(std::make_shared<GameStats>());
+  CloseBatches();
+}
+
+void Statistics::CloseBatches()
+{
+  for (; mClosed + 1 < mStats.size(); ++mClosed)
+    mClosedValues.Add(Value(*mStats[mClosed]));
+}
+
+uint32_t Statistics::Batches() const
+{
+  return mStats.size();
+}
+
+void Statistics::SetBatches(uint32_t batches)
+{
+  mBatches = batches;
+}
+
+void Statistics::Merge(const Statistics& other)
+{
+  for (const auto& stat : other.mStats)
+  {
+    mStats.push_back(std::make_shared<GameStats>(*stat));
+    ++mBatchIndex;
+  }
+
+  CloseBatches();
 }
 
 void Statistics::Dump()
@@ -50,10 +157,15 @@ void Statistics::Dump()
   auto stat = mStats[mBatchIndex];
   printf("=========================================\n");
   printf("Iteration done in %ld ms\n", std::chrono::duration_cast<std::chrono::milliseconds>(now - mPreviousEnd).count());
-  printf("The attacker won %u games and lost %u\n", stat->wins, stat->losses);
+  printf("The attacker won %g games and lost %g\n", stat->wins, stat->losses);
   printf("Entered %.0f and blocked %.0f doors \n", stat->doorsEntered, stat->doorsBlocked);
   printf("Calculated p value = %.6f\n", PValue(*stat));
   printf("Calculated q value = %.6f\n", QValue(*stat));
+  for (uint32_t i = 0; i < stat->replicas.size(); ++i)
+  {
+    const auto& replica = stat->replicas[i];
+    printf("Replica %u won %g and lost %g, p value = %.6f, q value = %.6f\n", i, replica.wins, replica.losses, PValue(replica), QValue(replica));
+  }
   printf("Current mean = %.6f\n", full.mean);
   printf("Current variance = %.6f\n", full.variance);
   printf("=========================================\n");
@@ -71,7 +183,12 @@ float Statistics::PValue(const GameStats& stat) const
 
 float Statistics::QValue(const GameStats& stat) const
 {
-  return Mean(stat.qSamples);
+  return stat.q.mean;
+}
+
+float Statistics::Value(const GameStats& stat) const
+{
+  return mType == TestType::Q_TEST ? QValue(stat) : PValue(stat);
 }
 
 bool Statistics::ZTest(const std::string& confidence, float observed) const
@@ -85,7 +202,7 @@ bool Statistics::ZTest(const std::string& confidence, float observed) const
   TestStats stats = GetStats();
 
   // Perform test
-  float deviation = std::sqrt(stats.variance / stats.samples.size());
+  float deviation = std::sqrt(stats.variance / stats.count);
   float zValue = std::abs((observed - stats.mean) / deviation);
   float pValue = mZTable.at(confidence);
 
@@ -99,6 +216,93 @@ bool Statistics::ZTest(const std::string& confidence, float observed) const
   return true;
 }
 
+bool Statistics::HalfWidth(const std::string& confidence, float& halfWidth) const
+{
+  float z;
+  RETURN_ON_FAILURE(ZValue(confidence, z));
+
+  TestStats stats = GetStats();
+  halfWidth = z * std::sqrt(stats.variance / stats.count);
+
+  return true;
+}
+
+bool Statistics::ReachedHalfWidth(const std::string& confidence, float halfWidth) const
+{
+  float z;
+  RETURN_ON_FAILURE(ZValue(confidence, z));
+
+  TestStats stats = GetStats();
+  if (stats.count < 2)
+    return false;
+
+  // Unbiased variance of the batches
+  double n = stats.count;
+  double variance = stats.variance * n / (n - 1);
+
+  return z * std::sqrt((variance + 1 / n) / n) <= halfWidth;
+}
+
+bool Statistics::ZValue(const std::string& confidence, float& z) const
+{
+  if (mZTable.find(confidence) == mZTable.end())
+  {
+    printf("Unknown confidence level provided: %s\n", confidence.c_str());
+    return false;
+  }
+
+  z = mZTable.at(confidence);
+  return true;
+}
+
+bool Statistics::Compare(const Statistics& other, PairedStats& paired) const
+{
+  uint32_t count = std::min(mStats.size(), other.mStats.size());
+  if (count < 2)
+    return false;
+
+  RunningStats mine;
+  RunningStats others;
+  RunningStats differences;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    float a = Value(*mStats[i]);
+    float b = other.Value(*other.mStats[i]);
+    mine.Add(a);
+    others.Add(b);
+    differences.Add(a - b);
+  }
+
+  paired.difference = differences.mean;
+  paired.variance = differences.Variance();
+  paired.count = differences.count;
+  paired.reduction = (mine.Variance() + others.Variance()) / std::max(differences.Variance(), 1e-12);
+
+  return true;
+}
+
+bool Statistics::PairIterations(PairedStats& paired) const
+{
+  RunningStats outcomes;
+  RunningStats pairs;
+  for (const auto& stat : mStats)
+  {
+    outcomes.Merge(stat->outcomes);
+    pairs.Merge(stat->pairs);
+  }
+
+  if (pairs.count < 2)
+    return false;
+
+  // Independent pairs would have half the variance of single iterations
+  paired.difference = pairs.mean;
+  paired.variance = pairs.Variance();
+  paired.count = pairs.count;
+  paired.reduction = outcomes.Variance() / 2 / std::max(pairs.Variance(), 1e-12);
+
+  return true;
+}
+
 bool Statistics::Save(const std::string& filename) const
 {
   auto now = std::chrono::system_clock::now();
@@ -114,12 +318,13 @@ bool Statistics::Save(const std::string& filename) const
   std::ofstream file(filename, std::ios::trunc);
   LOG_AND_RETURN_ON_FAILURE(file.is_open(), std::string("Could not open request file: " + filename).c_str());
 
-  // Get samples to be saved
+  // Runs of one batch only have samples to save with KeepSamples, which
+  // --config runs of one batch always use
   TestStats stats = GetStats();
 
   file << stats.mean << "\n";
   file << stats.variance << "\n";
-  for (const auto& s : stats.samples)
+  for (const auto& s : Samples())
     file << s << "\n";
 
   file.close();
@@ -127,66 +332,179 @@ bool Statistics::Save(const std::string& filename) const
   return true;
 }
 
-float Statistics::Mean(const std::vector<float>& samples) const
+bool Statistics::SavePartial(const std::string& filename, const nlohmann::json& header) const
+{
+  std::string dir = RemoveFilename(filename);
+  if (!DoesFileExist(dir) && !CreateDirectory(dir))
+  {
+    printf("Failed to create directory: %s\n", dir.c_str());
+    return false;
+  }
+
+  std::ofstream file(filename, std::ios::trunc);
+  LOG_AND_RETURN_ON_FAILURE(file.is_open(), std::string("Could not open partial file: " + filename).c_str());
+
+  nlohmann::json partial = header;
+  partial["batch_stats"] = nlohmann::json::array();
+  for (const auto& stat : mStats)
+    partial["batch_stats"].push_back(ToJson(*stat));
+
+  // Floats are written as doubles, which read back to the very same floats
+  file << partial.dump() << "\n";
+  file.close();
+
+  return true;
+}
+
+bool Statistics::MergePartial(const nlohmann::json& partial)
+{
+  try
+  {
+    for (const auto& config : partial.at("batch_stats"))
+    {
+      auto stat = std::make_shared<GameStats>();
+      FromJson(config, *stat);
+
+      mStats.push_back(stat);
+      ++mBatchIndex;
+    }
+
+    CloseBatches();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+static nlohmann::json RunningToJson(const RunningStats& running)
 {
-  if (samples.empty())
-    return 0;
+  return { {"count", running.count}, {"mean", running.mean}, {"m2", running.m2} };
+}
 
-  float mean = 0.0;
+static void RunningFromJson(const nlohmann::json& config, RunningStats& running)
+{
+  running.count = config.at("count");
+  running.mean = config.at("mean");
+  running.m2 = config.at("m2");
+}
 
-  std::for_each(samples.begin(), samples.end(), [&mean](float n){ mean += n; });
+nlohmann::json Statistics::ToJson(const GameStats& stat) const
+{
+  nlohmann::json config;
+  config["wins"] = stat.wins;
+  config["losses"] = stat.losses;
+  config["doors_entered"] = stat.doorsEntered;
+  config["doors_blocked"] = stat.doorsBlocked;
+  config["p"] = RunningToJson(stat.p);
+  config["q"] = RunningToJson(stat.q);
+  config["outcomes"] = RunningToJson(stat.outcomes);
+  config["pairs"] = RunningToJson(stat.pairs);
+  config["first_of_pair"] = stat.firstOfPair;
+  config["p_samples"] = stat.pSamples;
+  config["q_samples"] = stat.qSamples;
+
+  config["replicas"] = nlohmann::json::array();
+  for (const auto& replica : stat.replicas)
+    config["replicas"].push_back(ToJson(replica));
+
+  return config;
+}
 
-  return mean / samples.size();
+void Statistics::FromJson(const nlohmann::json& config, GameStats& stat) const
+{
+  stat.wins = float(config.at("wins"));
+  stat.losses = float(config.at("losses"));
+  stat.doorsEntered = float(config.at("doors_entered"));
+  stat.doorsBlocked = float(config.at("doors_blocked"));
+  RunningFromJson(config.at("p"), stat.p);
+  RunningFromJson(config.at("q"), stat.q);
+  RunningFromJson(config.at("outcomes"), stat.outcomes);
+  RunningFromJson(config.at("pairs"), stat.pairs);
+  stat.firstOfPair = float(config.at("first_of_pair"));
+  stat.pSamples = config.at("p_samples").get<std::vector<float>>();
+  stat.qSamples = config.at("q_samples").get<std::vector<float>>();
+
+  stat.replicas.resize(config.at("replicas").size());
+  for (uint32_t i = 0; i < stat.replicas.size(); ++i)
+    FromJson(config.at("replicas")[i], stat.replicas[i]);
 }
 
-float Statistics::Variance(const std::vector<float>& samples) const
+void RunningStats::Add(double value)
 {
-  if (samples.empty())
-    return 0;
+  ++count;
+  double delta = value - mean;
+  mean += delta / count;
+  m2 += delta * (value - mean);
+}
 
-  float variance = 0.0;
-  float mean = Mean(samples);
+void RunningStats::Merge(const RunningStats& other)
+{
+  if (other.count == 0)
+    return;
 
-  std::for_each(samples.begin(), samples.end(), [&variance, mean](float n){ variance += std::pow(n - mean, 2); });
+  if (count == 0)
+  {
+    *this = other;
+    return;
+  }
 
-  return variance / samples.size();
+  uint64_t total = count + other.count;
+  double delta = other.mean - mean;
+  mean += delta * other.count / total;
+  m2 += other.m2 + delta * delta * count * other.count / total;
+  count = total;
+}
+
+double RunningStats::Variance() const
+{
+  return count > 0 ? m2 / count : 0.0;
 }
 
 Statistics::TestStats Statistics::GetStats() const
 {
   TestStats stats;
-
-  std::vector<float> qSamples;
-  std::vector<float> pSamples;
+  if (mStats.empty())
+    return stats;
 
   // If the batch method was used then we have to take the
   // mean across the batches instead of across the samples
+  RunningStats values;
   if (mBatches > 1)
   {
-    for (auto& stat : mStats)
-    {
-      pSamples.push_back(PValue(*stat));
-      qSamples.push_back(QValue(*stat));
-    }
+    values = mClosedValues;
+    for (uint32_t i = mClosed; i < mStats.size(); ++i)
+      values.Add(Value(*mStats[i]));
   }
   else
   {
-    qSamples = mStats[mBatchIndex]->qSamples;
-    pSamples = mStats[mBatchIndex]->pSamples;
+    const auto& stat = *mStats[mBatchIndex];
+    values = mType == TestType::Q_TEST ? stat.q : stat.p;
   }
 
-  if (mType == TestType::Q_TEST)
+  stats.mean = values.mean;
+  stats.variance = values.Variance();
+  stats.count = values.count;
+
+  return stats;
+}
+
+std::vector<float> Statistics::Samples() const
+{
+  std::vector<float> samples;
+  if (mBatches > 1)
   {
-    stats.mean = Mean(qSamples);
-    stats.variance = Variance(qSamples);
-    stats.samples = qSamples;
+    for (const auto& stat : mStats)
+      samples.push_back(Value(*stat));
   }
-  else
+  else if (!mStats.empty())
   {
-    stats.mean = Mean(pSamples);
-    stats.variance = Variance(pSamples);
-    stats.samples = pSamples;
+    const auto& stat = *mStats[mBatchIndex];
+    samples = mType == TestType::Q_TEST ? stat.qSamples : stat.pSamples;
   }
 
-  return stats;
-}
\ No newline at end of file
+  return samples;
+}
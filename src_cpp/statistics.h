@@ -6,51 +6,150 @@
 #include <string>
 #include <vector>
 
+#include <nlohmann/json.hpp>
+
 #include "settings.h"
 
+// Mean and variance of a stream of values, kept up to date in constant
+// memory with Welford's method
+struct RunningStats
+{
+  uint64_t count = 0;
+  double mean = 0.0;
+  double m2 = 0.0;  // Sum of squared differences from the mean
+
+  void Add(double value);
+
+  // Fold in the values of another stream, as if they had been added here
+  void Merge(const RunningStats& other);
+
+  // Of the population, like the batch means have always been reported
+  double Variance() const;
+};
+
 class Statistics
 {
 public:
-  Statistics(const std::string& type, uint32_t batches, uint32_t iterations);
+  Statistics(const std::string& type, uint32_t dayLength, uint32_t batches, uint32_t iterations);
   ~Statistics();
 
   void UpdateStats(uint32_t iteration, Result result);
 
+  // Fold the branches of one split iteration into a single weighted sample
+  void UpdateStats(uint32_t iteration, const std::vector<WeightedResult>& branches);
+
+  // Attacker replicas of one iteration, each is also kept track of on its own
+  void UpdateReplicas(uint32_t iteration, const std::vector<Result>& replicas);
+
+  // Also keep every sample, which Save writes out for runs of one batch.
+  // Otherwise memory and the cost of Dump do not grow with the iterations
+  void KeepSamples(bool keep);
+
   void NewBatch();
   void Dump();
 
+  // Batches collected so far
+  uint32_t Batches() const;
+
+  // Number of batches the run ended up with, when it was not known up front
+  void SetBatches(uint32_t batches);
+
+  // Append the batches collected by another instance, e.g. on another thread
+  void Merge(const Statistics& other);
+
   bool Save(const std::string& filename) const;
 
+  // Write every batch exactly, together with header, so a shard of a run
+  // can later be merged as if all batches had been simulated in one process
+  bool SavePartial(const std::string& filename, const nlohmann::json& header) const;
+
+  // Append the batches of a partial file loaded as JSON
+  bool MergePartial(const nlohmann::json& partial);
+
   bool ZTest(const std::string& confidence, float observed) const;
 
-  float Mean(const std::vector<float>& samples) const;
-  float Variance(const std::vector<float>& samples) const;
+  // Half the width of the confidence interval around the current mean
+  bool HalfWidth(const std::string& confidence, float& halfWidth) const;
+
+  // Standard normal quantile of a two sided interval at confidence
+  bool ZValue(const std::string& confidence, float& z) const;
+
+  // Sequential stopping rule of Chow and Robbins for the batch method: true
+  // once the interval at confidence is at most halfWidth on either side of
+  // the mean, with 1/n added to the variance of the n batches so that a few
+  // batches which happen to agree cannot end a run
+  bool ReachedHalfWidth(const std::string& confidence, float halfWidth) const;
+
+  struct TestStats
+  {
+    float mean = 0.0;
+    float variance = 0.0;
+    uint64_t count = 0;  // Samples behind the estimate
+  };
+
+  // Estimate of the configured test over everything simulated so far, in
+  // constant time
+  TestStats GetStats() const;
+
+  struct PairedStats
+  {
+    float difference = 0.0;  // Mean of this run minus the other
+    float variance = 0.0;    // Of the paired differences
+    uint64_t count = 0;      // Pairs
+    float reduction = 0.0;   // Variance if the runs were independent over the paired one
+  };
+
+  // Pair the batches of this run with the same batches of another, e.g.
+  // two sweep points simulated with common random numbers
+  bool Compare(const Statistics& other, PairedStats& paired) const;
+
+  // Pair every even iteration with the odd one after it, as in runs with
+  // antithetic variates, and compare the variance of the pair means with
+  // that of independent pairs. Iterations are compared on their own
+  // outcome: the share of doors entered, or of the day taken, in it
+  bool PairIterations(PairedStats& paired) const;
+
+  // Samples behind GetStats: the value of every batch with the batch
+  // method, otherwise the kept samples of the last batch, if any
+  std::vector<float> Samples() const;
 
 private:
+  uint32_t mDayLength;
   uint32_t mBatches;
   uint32_t mBatchIndex;
   uint32_t mIterations;
+  bool mKeepSamples;
 
   struct GameStats
   {
-    uint32_t wins = 0;
-    uint32_t losses = 0;
+    float wins = 0.0;
+    float losses = 0.0;
     float doorsEntered = 0.0;
     float doorsBlocked = 0.0;
 
+    RunningStats p;  // Of the p value after every iteration
+    RunningStats q;  // Of the share of the day every iteration took
+
+    // Outcome of every iteration on its own, and the mean of every pair of
+    // iterations 2k and 2k + 1
+    RunningStats outcomes;
+    RunningStats pairs;
+    float firstOfPair = 0.0;
+
+    // Only filled with KeepSamples
     std::vector<float> pSamples;
     std::vector<float> qSamples;
-  };
 
-  struct TestStats
-  {
-    float mean = 0.0;
-    float variance = 0.0;
-    std::vector<float> samples;
+    // Only filled when running with attacker replicas
+    std::vector<GameStats> replicas;
   };
 
   std::vector<std::shared_ptr<GameStats>> mStats;
 
+  // Values of the batches before mClosed, which do not change any more
+  RunningStats mClosedValues;
+  uint32_t mClosed;
+
   enum class TestType
   {
     P_TEST,
@@ -67,8 +166,19 @@ private:
    std::chrono::_V2::system_clock::time_point mStart;
    std::chrono::_V2::system_clock::time_point mPreviousEnd;
 
-  TestStats GetStats() const;
+  void Add(GameStats& stat, const Result& result, float weight) const;
+  void AddSamples(GameStats& stat, float p, float q) const;
+  void AddOutcome(GameStats& stat, uint32_t iteration, float outcome) const;
+
+  // Fold every batch but the last, which may still be running, into mClosedValues
+  void CloseBatches();
+
+  nlohmann::json ToJson(const GameStats& stat) const;
+  void FromJson(const nlohmann::json& config, GameStats& stat) const;
 
   float PValue(const GameStats& stat) const;
   float QValue(const GameStats& stat) const;
+
+  // Of the configured test
+  float Value(const GameStats& stat) const;
 };
\ No newline at end of file
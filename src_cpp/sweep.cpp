@@ -0,0 +1,399 @@
+#include "sweep.h"
+
+#include <stdio.h>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include "batch_runner.h"
+#include "helpers.h"
+#include "level_file.h"
+#include "result_cache.h"
+#include "statistics.h"
+
+using json = nlohmann::json;
+
+static std::vector<std::string> SplitPath(const std::string& path)
+{
+  std::vector<std::string> keys;
+  std::stringstream stream(path);
+  std::string key;
+  while (std::getline(stream, key, '/'))
+  {
+    if (!key.empty())
+      keys.push_back(key);
+  }
+
+  return keys;
+}
+
+// Overwrite every value the keys lead to, a key missing from the level is an
+// error rather than a new entry nothing would ever read
+static bool SetPath(json& node, const std::vector<std::string>& keys, uint32_t depth, const json& value)
+{
+  if (depth == keys.size())
+  {
+    node = value;
+    return true;
+  }
+
+  const std::string& key = keys[depth];
+  if (node.is_array())
+  {
+    if (key == "*")
+    {
+      for (auto& element : node)
+        RETURN_ON_FAILURE(SetPath(element, keys, depth + 1, value));
+
+      return true;
+    }
+
+    char* end = nullptr;
+    unsigned long index = std::strtoul(key.c_str(), &end, 10);
+    if (*end != '\0' || index >= node.size())
+    {
+      printf("No element %s in the array\n", key.c_str());
+      return false;
+    }
+
+    return SetPath(node[index], keys, depth + 1, value);
+  }
+
+  if (!node.is_object() || !node.contains(key))
+  {
+    printf("No key %s in the level\n", key.c_str());
+    return false;
+  }
+
+  return SetPath(node[key], keys, depth + 1, value);
+}
+
+bool SetConfigValue(nlohmann::json& config, const std::string& path, const nlohmann::json& value)
+{
+  return SetPath(config, SplitPath(path), 0, value);
+}
+
+Sweep::Sweep()
+{
+}
+
+Sweep::~Sweep()
+{
+}
+
+bool Sweep::Init(const std::string& sweepFile)
+{
+  std::ifstream f(sweepFile);
+  if (!f.is_open())
+  {
+    printf("Could not open file: %s\n", sweepFile.c_str());
+    return false;
+  }
+
+  // Keep the order of the file, the first parameter changes slowest
+  nlohmann::ordered_json sweep;
+  try
+  {
+    sweep = nlohmann::ordered_json::parse(f);
+
+    mConfigFile = sweep["config"];
+    if (mConfigFile.front() != '/')
+      mConfigFile = RemoveFilename(sweepFile) + mConfigFile;
+    mName = sweep.value("name", "");
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  if (IsCompiledLevel(mConfigFile))
+  {
+    printf("Compiled levels cannot be swept, use the JSON config instead\n");
+    return false;
+  }
+
+  std::ifstream config(mConfigFile);
+  if (!config.is_open())
+  {
+    printf("Could not open file: %s\n", mConfigFile.c_str());
+    return false;
+  }
+
+  try
+  {
+    mConfig = json::parse(config);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  LOG_AND_RETURN_ON_FAILURE(!mConfig.contains("floors"), "Buildings cannot be swept, sweep one of their floors instead");
+
+  if (sweep.contains("grid"))
+  {
+    LOG_AND_RETURN_ON_FAILURE(ParseGrid(sweep["grid"]), "Failed to parse sweep grid");
+  }
+  else if (sweep.contains("points"))
+  {
+    LOG_AND_RETURN_ON_FAILURE(ParsePoints(sweep["points"]), "Failed to parse sweep points");
+  }
+  else
+  {
+    printf("Sweep file needs a grid or a list of points: %s\n", sweepFile.c_str());
+    return false;
+  }
+
+  LOG_AND_RETURN_ON_FAILURE(!mPoints.empty(), "Sweep has no points");
+
+  if (mName.empty())
+  {
+    for (const auto& parameter : mParameters)
+      mName += (mName.empty() ? "" : "_") + SplitPath(parameter).back();
+  }
+
+  return BuildPoints();
+}
+
+bool Sweep::ParseGrid(const nlohmann::ordered_json& grid)
+{
+  try
+  {
+    // Every combination, the last parameter changes fastest
+    mPoints.push_back(Point());
+    for (const auto& [parameter, values] : grid.items())
+    {
+      if (!values.is_array() || values.empty())
+      {
+        printf("Parameter %s needs a list of values\n", parameter.c_str());
+        return false;
+      }
+
+      mParameters.push_back(parameter);
+
+      std::vector<Point> points;
+      for (const auto& point : mPoints)
+      {
+        for (const auto& value : values)
+        {
+          points.push_back(Point());
+          points.back().values = point.values;
+          points.back().values.push_back(json::parse(value.dump()));
+        }
+      }
+      mPoints = std::move(points);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return !mParameters.empty();
+}
+
+bool Sweep::ParsePoints(const nlohmann::ordered_json& points)
+{
+  try
+  {
+    // Parameters come from the first point, the others have to set the same
+    for (const auto& [parameter, value] : points.at(0).items())
+      mParameters.push_back(parameter);
+
+    for (const auto& values : points)
+    {
+      if (values.size() != mParameters.size())
+      {
+        printf("Every sweep point needs the same parameters\n");
+        return false;
+      }
+
+      mPoints.push_back(Point());
+      for (const auto& parameter : mParameters)
+        mPoints.back().values.push_back(json::parse(values.at(parameter).dump()));
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool Sweep::BuildPoints()
+{
+  Blueprint base;
+  if (!base.Init(mConfig))
+  {
+    printf("Invalid configuration file: %s\n", mConfigFile.c_str());
+    return false;
+  }
+
+  for (auto& point : mPoints)
+  {
+    json config = mConfig;
+    for (uint32_t i = 0; i < mParameters.size(); ++i)
+    {
+      if (!SetConfigValue(config, mParameters[i], point.values[i]))
+      {
+        printf("Cannot set %s\n", mParameters[i].c_str());
+        return false;
+      }
+    }
+
+    point.config = config;
+    if (!point.blueprint.Init(config, base.navigation))
+    {
+      printf("Invalid sweep point %s\n", PointName(point).c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::string Sweep::PointName(const Point& point) const
+{
+  std::string name;
+  for (const auto& value : point.values)
+  {
+    std::string text;
+    if (value.is_number())
+    {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%g", value.get<double>());
+      text = buffer;
+    }
+    else
+    {
+      text = value.is_string() ? value.get<std::string>() : value.dump();
+    }
+
+    name += (name.empty() ? "" : "_") + text;
+  }
+
+  return name;
+}
+
+bool Sweep::Run(const Args& args, const std::string& outDirectory, const ResultCache* cache)
+{
+  // Nothing can be shown when several points run at the same time
+  Args hidden = args;
+  hidden.hidden = true;
+
+  std::string directory = outDirectory + mName + "/";
+  std::string level = GetFilename(mConfigFile);
+
+  // Statistics::Save only creates the last directory
+  if (!DoesFileExist(outDirectory) && !CreateDirectory(outDirectory))
+  {
+    printf("Failed to create directory: %s\n", outDirectory.c_str());
+    return false;
+  }
+
+  printf("Sweeping %s over %zu points of %s\n", level.c_str(), mPoints.size(), mName.c_str());
+
+  // Batches found in the cache are not simulated again
+  std::vector<std::string> keys(mPoints.size());
+  std::vector<std::unique_ptr<Statistics>> cached(mPoints.size() * args.batches);
+  for (uint32_t p = 0; cache && p < mPoints.size(); ++p)
+  {
+    const Blueprint& blueprint = mPoints[p].blueprint;
+    uint32_t iterations = args.iterations > 0 ? args.iterations : blueprint.iterations;
+    keys[p] = ResultCache::Key(mPoints[p].config, args, iterations);
+
+    for (uint32_t i = 0; i < args.batches; ++i)
+    {
+      auto stats = std::make_unique<Statistics>(blueprint.testType, blueprint.dayDuration, 1, iterations);
+      if (cache->Load(keys[p], i, *stats))
+        cached[p * args.batches + i] = std::move(stats);
+    }
+  }
+
+  // Batches of every point share one queue, so the threads stay busy until
+  // the last point is done. Points use the same batch numbers and therefore
+  // the same random numbers, which makes their differences less noisy
+  BatchRunner runner(args.threads);
+  for (uint32_t p = 0; p < mPoints.size(); ++p)
+  {
+    const Blueprint& blueprint = mPoints[p].blueprint;
+    uint32_t iterations = args.iterations > 0 ? args.iterations : blueprint.iterations;
+    Args point = hidden;
+    if (!args.record.empty())
+      point.record = args.record + level + "_" + PointName(mPoints[p]) + "_";
+
+    for (uint32_t i = 0; i < args.batches; ++i)
+    {
+      if (!cached[p * args.batches + i])
+        runner.Add(blueprint, point, i, iterations);
+    }
+  }
+
+  runner.Start();
+
+  printf("%-24s %10s %10s %8s\n", "point", "mean", "std err", "cached");
+
+  // Kept to compare every point with the first one
+  std::vector<std::unique_ptr<Statistics>> results;
+  for (uint32_t p = 0; p < mPoints.size(); ++p)
+  {
+    const Blueprint& blueprint = mPoints[p].blueprint;
+    uint32_t iterations = args.iterations > 0 ? args.iterations : blueprint.iterations;
+
+    uint32_t hits = 0;
+    results.push_back(std::make_unique<Statistics>(blueprint.testType, blueprint.dayDuration, args.batches, iterations));
+    Statistics& stats = *results.back();
+    for (uint32_t i = 0; i < args.batches; ++i)
+    {
+      auto& entry = cached[p * args.batches + i];
+      if (entry)
+      {
+        stats.Merge(*entry);
+        entry.reset();
+        ++hits;
+        continue;
+      }
+
+      auto batch = runner.Next();
+      LOG_AND_RETURN_ON_FAILURE(batch.ok, "Failed to set up the simulation");
+
+      // Stored right away, so a crash only loses the batches still running
+      if (cache)
+        cache->Store(keys[p], i, *batch.stats);
+
+      stats.Merge(*batch.stats);
+    }
+
+    std::string name = PointName(mPoints[p]);
+    RETURN_ON_FAILURE(stats.Save(directory + level + "_" + name + ".txt"));
+
+    auto result = stats.GetStats();
+    printf("%-24s %10.6f %10.6f %4u/%-3u\n", name.c_str(), result.mean, std::sqrt(result.variance / result.count), hits, args.batches);
+  }
+
+  // Batch i of every point ran on the same random numbers, so the
+  // differences are estimated from pairs of batches
+  if (mPoints.size() < 2 || args.batches < 2)
+    return true;
+
+  printf("\nPaired with %s over %u batches%s\n", PointName(mPoints[0]).c_str(), args.batches, args.commonRandom ? ", common random numbers" : "");
+  printf("%-24s %10s %10s %10s\n", "point", "difference", "std err", "reduction");
+  for (uint32_t p = 1; p < mPoints.size(); ++p)
+  {
+    Statistics::PairedStats paired;
+    if (!results[p]->Compare(*results[0], paired))
+      continue;
+
+    printf("%-24s %+10.6f %10.6f %9.2fx\n", PointName(mPoints[p]).c_str(), paired.difference, std::sqrt(paired.variance / paired.count), paired.reduction);
+  }
+
+  return true;
+}
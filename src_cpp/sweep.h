@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "blueprint.h"
+#include "result_cache.h"
+#include "settings.h"
+
+// Overwrite the value at a path of a level config, see below for the paths
+bool SetConfigValue(nlohmann::json& config, const std::string& path, const nlohmann::json& value);
+
+// Runs one level with many parameter combinations in a single process. A
+// sweep file names the level and either a grid of values, every combination
+// of which is simulated, or an explicit list of points:
+//
+//   { "config": "../verified/level_12_q.json",
+//     "grid": { "guards/number_of_guards": [5, 6, 7],
+//               "guards/config/*/stroll_speed": [1, 2] } }
+//
+//   { "config": "../verified/level_12_q.json",
+//     "points": [ { "guards/number_of_guards": 5, "attacker/speed": 1 },
+//                 { "guards/number_of_guards": 8, "attacker/speed": 2 } ] }
+//
+// Paths are keys separated by "/", "*" stands for every element of an array.
+// The config is relative to the sweep file. The level is parsed once and
+// points which do not move any wall share its navigation grid. Every point
+// is written to <out-dir>/<name>/<level>_<values>.txt, where the name
+// defaults to the last key of every parameter.
+class Sweep
+{
+public:
+  Sweep();
+  ~Sweep();
+
+  bool Init(const std::string& sweepFile);
+
+  // Simulate the batches of every point, args.threads at a time. Batches
+  // found in the cache are reused and new ones are added to it
+  bool Run(const Args& args, const std::string& outDirectory, const ResultCache* cache = nullptr);
+
+private:
+  struct Point
+  {
+    std::vector<nlohmann::json> values;  // One per parameter
+    nlohmann::json config;               // Level with the values applied
+    Blueprint blueprint;
+  };
+
+  std::string mConfigFile;
+  std::string mName;
+  nlohmann::json mConfig;
+
+  std::vector<std::string> mParameters;
+  std::vector<Point> mPoints;
+
+  bool ParseGrid(const nlohmann::ordered_json& grid);
+  bool ParsePoints(const nlohmann::ordered_json& points);
+  bool BuildPoints();
+
+  std::string PointName(const Point& point) const;
+};
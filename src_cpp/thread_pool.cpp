@@ -0,0 +1,91 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(uint32_t threads)
+    : mTask(nullptr)
+    , mCount(0)
+    , mNext(0)
+    , mBusy(0)
+    , mGeneration(0)
+    , mStop(false)
+{
+  for (uint32_t i = 1; i < threads; ++i)
+    mWorkers.emplace_back([this]{ Work(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mWake.notify_all();
+
+  for (auto& worker : mWorkers)
+    worker.join();
+}
+
+uint32_t ThreadPool::Size() const
+{
+  return mWorkers.size() + 1;
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& task)
+{
+  if (count == 0)
+    return;
+
+  // Not worth waking anyone up
+  if (mWorkers.empty() || count == 1)
+  {
+    for (uint32_t i = 0; i < count; ++i)
+      task(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTask = &task;
+    mCount = count;
+    mNext = 0;
+    mBusy = mWorkers.size();
+    ++mGeneration;
+  }
+  mWake.notify_all();
+
+  RunTasks();
+
+  // Workers may still be finishing their last task
+  std::unique_lock<std::mutex> lock(mMutex);
+  mDone.wait(lock, [this]{ return mBusy == 0; });
+  mTask = nullptr;
+}
+
+void ThreadPool::RunTasks()
+{
+  for (uint32_t i = mNext++; i < mCount; i = mNext++)
+    (*mTask)(i);
+}
+
+void ThreadPool::Work()
+{
+  uint64_t generation = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mWake.wait(lock, [this, generation]{ return mStop || mGeneration != generation; });
+      if (mStop)
+        return;
+
+      generation = mGeneration;
+    }
+
+    RunTasks();
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      --mBusy;
+    }
+    mDone.notify_one();
+  }
+}
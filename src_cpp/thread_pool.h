@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads used to split one loop across cores.
+// The calling thread takes part in the work, so a pool of N threads
+// starts N - 1 workers.
+class ThreadPool
+{
+public:
+  ThreadPool(uint32_t threads);
+  ~ThreadPool();
+
+  // Calls task(i) for every i in [0, count) and returns once all calls are done
+  void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& task);
+
+  uint32_t Size() const;
+
+private:
+  std::vector<std::thread> mWorkers;
+
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::condition_variable mDone;
+
+  const std::function<void(uint32_t)>* mTask;
+  uint32_t mCount;
+  std::atomic<uint32_t> mNext;
+
+  uint32_t mBusy;
+  uint64_t mGeneration;
+  bool mStop;
+
+  void Work();
+  void RunTasks();
+};